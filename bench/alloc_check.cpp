@@ -0,0 +1,82 @@
+#include "../include/field.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+
+namespace {
+    std::atomic<size_t> allocations = 0;
+    std::atomic<bool> counting = false;
+
+    void *allocate(size_t size) {
+        if (counting.load(std::memory_order_relaxed)) {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (void *ptr = std::malloc(size == 0 ? 1 : size)) {
+            return ptr;
+        }
+        throw std::bad_alloc();
+    }
+
+    size_t count(const std::string &path, int warmup, int ticks, int workers, Emulator::FlowSolverKind solver) {
+        using type = Emulator::Fixed<64, 8, false>;
+        auto field = std::make_unique<Emulator::FieldEmulator<type, type, type, -1, -1>>();
+        field->load(path);
+        field->init_workers(workers);
+        field->set_output(Emulator::OutputPolicy("none"));
+        field->set_flow_solver(solver);
+
+        for (int i = 0; i < warmup; ++i) {
+            field->next(i);
+        }
+        allocations = 0;
+        counting = true;
+        for (int i = warmup; i < warmup + ticks; ++i) {
+            field->next(i);
+        }
+        counting = false;
+        return allocations;
+    }
+}
+
+void *operator new(size_t size) {
+    return allocate(size);
+}
+
+void *operator new[](size_t size) {
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+/// Считает выделения памяти в куче во всех потоках за тики после прогрева, когда все буферы уже достигли рабочего
+/// размера. Код возврата 1, если тик выделяет память.
+/// Запуск: alloc_check [путь к полю] [тики прогрева] [тики замера] [число потоков] [dfs|dinic|push-relabel]
+int main(int argc, char **argv) {
+    std::string path = argc > 1 ? argv[1] : "field.txt";
+    int warmup = argc > 2 ? std::stoi(argv[2]) : 50;
+    int ticks = argc > 3 ? std::stoi(argv[3]) : 200;
+    int workers = argc > 4 ? std::stoi(argv[4]) : 2;
+    auto solver = Emulator::get_flow_solver(argc > 5 ? argv[5] : "dfs");
+
+    size_t result = count(path, warmup, ticks, workers, solver);
+    std::cout << result << " allocations in " << ticks << " ticks" << std::endl;
+    return result == 0 ? 0 : 1;
+}
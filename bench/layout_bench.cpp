@@ -0,0 +1,58 @@
+#include "../include/field.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <streambuf>
+#include <string>
+
+namespace {
+    using type = Emulator::Fixed<64, 8, false>;
+
+    /// Поток-заглушка, чтобы вывод поля не влиял на замер
+    struct NullBuffer : std::streambuf {
+        int overflow(int c) override { return c; }
+    };
+
+    template<typename Layout>
+    double measure(const std::string &path, int ticks, int workers) {
+        // Поле со своими потоками уничтожается в конце замера, чтобы раскладки не копились в памяти
+        auto field = std::make_unique<Emulator::FieldEmulator<type, type, type, -1, -1, Layout>>();
+        field->load(path);
+        field->init_workers(workers);
+        field->set_output(Emulator::OutputPolicy("none"));
+
+        auto timer = std::chrono::steady_clock::now();
+        for (int i = 0; i < ticks; ++i) {
+            field->next(i);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - timer).count();
+        // Поток вывода не должен писать в `NullBuffer` после выхода из замера
+        field->finish();
+        return seconds;
+    }
+
+    template<typename Layout>
+    void report(const std::string &name, const std::string &path, int ticks, int workers) {
+        auto *out = std::cout.rdbuf();
+        NullBuffer null;
+        std::cout.rdbuf(&null);
+        double seconds = measure<Layout>(path, ticks, workers);
+        std::cout.rdbuf(out);
+        std::cout << name << "\t" << seconds << " s\t" << ticks / seconds << " ticks/s" << std::endl;
+    }
+}
+
+/// Сравнение построчной и блочной раскладки горячих массивов на полном тике. Основное время тика занимают
+/// последовательные `apply_forces_on_flow` и `apply_move_on_flow`, поэтому при одном потоке замер отражает именно их
+/// Запуск: layout_bench [путь к полю] [число тиков] [число потоков]
+int main(int argc, char **argv) {
+    std::string path = argc > 1 ? argv[1] : "field.txt";
+    int ticks = argc > 2 ? std::stoi(argv[2]) : 1000;
+    int workers = argc > 3 ? std::stoi(argv[3]) : 1;
+
+    report<Emulator::RowMajor>("row-major", path, ticks, workers);
+    report<Emulator::Tiled<4>>("tiled 4x4", path, ticks, workers);
+    report<Emulator::Tiled<8>>("tiled 8x8", path, ticks, workers);
+    report<Emulator::Tiled<16>>("tiled 16x16", path, ticks, workers);
+}
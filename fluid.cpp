@@ -1,5 +1,7 @@
 #include <bits/stdc++.h>
 
+#include "include/argument.h"
+
 using namespace std;
 
 constexpr size_t N = 94, M = 84;
@@ -342,7 +344,34 @@ bool propagate_move(int x, int y, bool is_first) {
 
 int dirs[N][M]{};
 
-int main() {
+void load_field(const string &path) {
+    ifstream in(path);
+    size_t n, m;
+    int t, ut;
+    if (not (in >> n >> m >> t >> ut) or n != N or m != M) {
+        cout << "Error: raw_fluid supports only " << N << "x" << M << " fields" << endl;
+        exit(-1);
+    }
+    for (size_t x = 0; x < N; ++x) {
+        for (size_t y = 0; y < M; ++y) {
+            int c;
+            in >> c;
+            field[x][y] = char(c);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    ArgumentParser args(argc, argv);
+    size_t ticks = stoul(args.get_option("--ticks", to_string(T)));
+    rnd.seed(stoul(args.get_option("--seed", "1337")));
+    bool log_p = args.get_option("--log-p", "0") == "1";
+    vector<double> p_log;
+    string path = args.get_option("--field", "");
+    if (not path.empty()) {
+        load_field(path);
+    }
+
     rho[' '] = 0.01;
     rho['.'] = 1000;
     Fixed g = 0.1;
@@ -359,7 +388,7 @@ int main() {
 
 
     auto timer = std::chrono::steady_clock::now();
-    for (size_t i = 0; i < T; ++i) {
+    for (size_t i = 0; i < ticks; ++i) {
         Fixed total_delta_p = 0;
         // Apply external forces
         for (size_t x = 0; x < N; ++x) {
@@ -456,6 +485,16 @@ int main() {
             }
         }
 
+        if (log_p) {
+            double sum = 0;
+            for (size_t x = 0; x < N; ++x) {
+                for (size_t y = 0; y < M; ++y) {
+                    sum += p[x][y].v / (double) (1 << 16);
+                }
+            }
+            p_log.push_back(sum);
+        }
+
         if (prop) {
             cout << "Tick " << i << ":\n";
             for (size_t x = 0; x < N; ++x) {
@@ -466,6 +505,9 @@ int main() {
             break;
         }
     }
+    for (size_t i = 0; i < p_log.size(); ++i) {
+        cout << "Pressure " << i << " " << setprecision(12) << p_log[i] << "\n";
+    }
     std::cout << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - timer).count()
               << std::endl;
 }
\ No newline at end of file
@@ -25,4 +25,11 @@ public:
         }
         return args_[target];
     }
+
+    std::string get_option(const std::string &target, const std::string &default_value) {
+        if (not args_.contains(target)) {
+            return default_value;
+        }
+        return args_[target];
+    }
 };
\ No newline at end of file
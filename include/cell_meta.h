@@ -0,0 +1,41 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+namespace Emulator {
+    /// Тип эпохи посещения клетки. Эпохи сравниваются только с текущей `UT` и `UT - 1`, поэтому при приближении к
+    /// переполнению достаточно сбросить все отметки в 0 (см. `FieldEmulator::next_epoch`)
+    using epoch_t = uint16_t;
+
+    constexpr int max_epoch = std::numeric_limits<epoch_t>::max();
+
+    /// Горячие метаданные клетки, к которым обращаются обходы `propagate_*`. Занимают 4 байта вместо 16 байт
+    /// отдельных массивов `dirs` и `last_use` и избавляют от чтения `field` соседей при проверке на стену.
+    /// Упакованы только метаданные: `velocity` и `velocity_flow` остаются отдельными массивами, потому что вместе с ними
+    /// клетка из 64-битных `FIXED` заняла бы больше 64 байт и всё равно задевала две кэш-линии, а фазы по строкам
+    /// (`g`, силы давления, пересчёт `p`) читают только скорости и тянули бы в кэш лишние байты
+    struct CellMeta {
+        epoch_t last_use = 0;
+
+        /// Биты 0-3 - сосед по направлению `deltas[i]` не стена, биты 4-6 - число таких соседей, бит 7 - сама клетка стена
+        uint8_t info = 0;
+
+        [[nodiscard]] bool open(size_t dir) const {
+            return info >> dir & 1;
+        }
+
+        [[nodiscard]] int64_t dirs() const {
+            return info >> 4 & 7;
+        }
+
+        [[nodiscard]] bool is_wall() const {
+            return info >> 7;
+        }
+
+        constexpr void set(bool wall, uint8_t open_mask) {
+            info = uint8_t(wall << 7 | std::popcount(open_mask) << 4 | open_mask);
+        }
+    };
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "page_memory.h"
+
+namespace Emulator {
+    /// Счётчики по клеткам за весь прогон: сколько раз обходы `propagate_*` заходили в клетку. Включается
+    /// `--heatmap=1`, в `finish` выгружаются рядом с картой картинками PGM и таблицей CSV
+    class CellProfile {
+    public:
+        enum Counter {
+            /// Вход обхода `propagate_flow` в клетку
+            flow_visits,
+            /// Поток, добавленный на ребро из клетки при насыщении найденного цикла
+            flow_augmentations,
+            /// Вход `propagate_move` в клетку
+            move_visits,
+            /// Клетка, остановленная `propagate_stop`
+            stop_visits,
+            count,
+        };
+
+        static constexpr std::array<const char *, count> names{
+                "flow_visits", "flow_augmentations", "move_visits", "stop_visits"};
+
+    private:
+        std::array<PageVector<uint64_t>, count> counters;
+        std::string prefix;
+        bool active = false;
+        int N = 0;
+        int K = 0;
+
+    public:
+        [[nodiscard]] bool enabled() const {
+            return active;
+        }
+
+        /// \param path Префикс файлов, пустой - счётчики выключены
+        void init(const std::string &path, int n, int k) {
+            prefix = path;
+            active = not prefix.empty();
+            N = n;
+            K = k;
+            for (auto &counter: counters) {
+                counter.assign(enabled() ? size_t(N) * K : 0, 0);
+            }
+        }
+
+        void add(Counter counter, int x, int y) {
+            if (active) [[unlikely]] {
+                ++counters[counter][size_t(x) * K + y];
+            }
+        }
+
+        /// `<префикс>.<счётчик>.pgm` на каждый счётчик и `<префикс>.heatmap.csv`
+        /// \param field Символ клетки, чтобы отличать в таблице стены и жидкости
+        void write(auto field) const {
+            if (not enabled()) {
+                return;
+            }
+            for (int c = 0; c < count; ++c) {
+                write_pgm(prefix + "." + names[c] + ".pgm", counters[c]);
+            }
+            std::string path = prefix + ".heatmap.csv";
+            std::ofstream out(path);
+            if (not out.is_open()) {
+                std::cout << "Error: can`t open file `" << path << "`" << std::endl;
+                return;
+            }
+            out << "x,y,cell";
+            for (const char *name: names) {
+                out << "," << name;
+            }
+            out << "\n";
+            for (int x = 0; x < N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    char cell = field(x, y);
+                    out << x << "," << y << ",";
+                    if (cell == ',' or cell == '"') {
+                        out << '"' << (cell == '"' ? "\"\"" : ",") << '"';
+                    } else {
+                        out << cell;
+                    }
+                    for (const auto &counter: counters) {
+                        out << "," << counter[size_t(x) * K + y];
+                    }
+                    out << "\n";
+                }
+            }
+        }
+
+    private:
+        /// Яркость - логарифм счётчика относительно наибольшего, чтобы редкие заходы тоже были видны
+        void write_pgm(const std::string &path, const PageVector<uint64_t> &counter) const {
+            std::ofstream out(path, std::ios::binary);
+            if (not out.is_open()) {
+                std::cout << "Error: can`t open file `" << path << "`" << std::endl;
+                return;
+            }
+            double top = std::log1p(double(std::ranges::max(counter)));
+            out << "P5\n" << K << " " << N << "\n255\n";
+            std::vector<char> row(K);
+            for (int x = 0; x < N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    double value = top > 0 ? std::log1p(double(counter[size_t(x) * K + y])) / top : 0;
+                    row[y] = char(std::lround(value * 255));
+                }
+                out.write(row.data(), K);
+            }
+        }
+    };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include "cell_meta.h"
+#include "utilities.h"
+
+namespace Emulator {
+    /// Карта, встроенная при сборке (см. `FLUID_MAPS` в CMakeLists.txt). `Source` - сгенерированный тип с полями
+    /// `name` и `data`: числа файла карты подряд, то есть `N K t UT` и коды клеток по строкам.
+    /// Стены не двигаются, поэтому маска стен, `CellMeta` клеток и границы строк без стен - константы компиляции
+    template<typename Source>
+    struct EmbeddedMap {
+        static constexpr const char *name = Source::name;
+        static constexpr int N = Source::data[0];
+        static constexpr int K = Source::data[1];
+
+        static_assert(std::size(Source::data) == 4 + N * K, "embedded map size does not match its header");
+
+        /// Маска стен по строкам, байт на клетку, как у `field`
+        static constexpr std::array<bool, N * K> walls = [] {
+            std::array<bool, N * K> res{};
+            for (int i = 0; i < N * K; ++i) {
+                res[i] = Source::data[4 + i] == '#';
+            }
+            return res;
+        }();
+
+        static constexpr bool wall(int x, int y) {
+            return walls[x * K + y];
+        }
+
+        /// Метаданные клеток по строкам, `last_use` нулевые
+        static constexpr std::array<CellMeta, N * K> meta = [] {
+            std::array<CellMeta, N * K> res{};
+            for (int x = 0; x < N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    uint8_t open = 0;
+                    if (not wall(x, y)) {
+                        for_each_direction([&](auto dir) {
+                            open |= (not wall(x + dir.dx, y + dir.dy)) << dir.index;
+                        });
+                    }
+                    res[x * K + y].set(wall(x, y), open);
+                }
+            }
+            return res;
+        }();
+
+        /// Для каждой строки столбцы [first, last) между крайними клетками без стен, пустой отрезок у строк из стен
+        static constexpr std::array<std::pair<int, int>, N> columns = [] {
+            std::array<std::pair<int, int>, N> res{};
+            for (int x = 0; x < N; ++x) {
+                int first = K, last = 0;
+                for (int y = 0; y < K; ++y) {
+                    if (not wall(x, y)) {
+                        first = std::min(first, y);
+                        last = y + 1;
+                    }
+                }
+                res[x] = first < last ? std::pair(first, last) : std::pair(0, 0);
+            }
+            return res;
+        }();
+
+        /// Совпадает ли расположение стен в файле карты со встроенной картой
+        static bool matches(const std::string &path) {
+            std::ifstream file(path);
+            int n, k, t, ut;
+            if (not(file >> n >> k >> t >> ut) or n != N or k != K) {
+                return false;
+            }
+            for (int x = 0; x < N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    int cell;
+                    if (not(file >> cell) or (cell == '#') != wall(x, y)) {
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+    };
+}
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "numbers.h"
+#include "page_memory.h"
+#include "utilities.h"
+
+namespace Emulator {
+    /// Настройки выгрузки `p`, `velocity` и `velocity_flow`. Опции запуска:
+    /// `--export=<префикс>`, `--export-fields=p,velocity,velocity_flow`, `--export-stride=S`, `--export-every=T`
+    struct ExportOptions {
+        std::string prefix;
+        bool p = true;
+        bool velocity = true;
+        bool velocity_flow = true;
+        /// Шаг по строкам и столбцам поля
+        int stride = 1;
+        /// Выгружается каждый `every`-й тик
+        int every = 1;
+
+        [[nodiscard]] bool enabled() const {
+            return not prefix.empty();
+        }
+
+        void set_fields(const std::string &list) {
+            p = velocity = velocity_flow = false;
+            std::stringstream in(list);
+            std::string name;
+            while (std::getline(in, name, ',')) {
+                if (name == "p") {
+                    p = true;
+                } else if (name == "velocity") {
+                    velocity = true;
+                } else if (name == "velocity_flow") {
+                    velocity_flow = true;
+                } else {
+                    std::cout << "Error: unknown export field `" << name << "`" << std::endl;
+                    exit(-1);
+                }
+            }
+        }
+    };
+
+    namespace details {
+        template<typename T>
+        struct npy_type {
+            using raw = T;
+            static constexpr int frac_bits = 0;
+
+            static std::string descr() {
+                return sizeof(T) == 4 ? "<f4" : "<f8";
+            }
+
+            static raw get(const T &value) {
+                return value;
+            }
+        };
+
+        /// Числа с фиксированной точкой выгружаются как есть, целым `v`; число дробных бит пишется в `.json`
+        template<int N, int K, bool fast>
+        struct npy_type<Fixed<N, K, fast>> {
+            using raw = typename Fixed<N, K, fast>::real_t;
+            static constexpr int frac_bits = K;
+
+            static std::string descr() {
+                return (sizeof(raw) == 1 ? "|i" : "<i") + std::to_string(sizeof(raw));
+            }
+
+            static raw get(const Fixed<N, K, fast> &value) {
+                return value.v;
+            }
+        };
+    }
+
+    /// Потоковая запись массива формата `.npy` версии 1.0. Заголовок имеет фиксированный размер и переписывается
+    /// при каждом `flush`, так что файл в любой момент читается `numpy.load(..., mmap_mode='r')`, а данные
+    /// начинаются с выровненного смещения `header_size`
+    class NpyWriter {
+        static constexpr size_t header_size = 128;
+
+        std::FILE *file = nullptr;
+        std::string descr;
+        std::vector<int> frame_shape;
+        size_t frames = 0;
+        std::vector<char> pending;
+
+    public:
+        NpyWriter() = default;
+
+        NpyWriter(const NpyWriter &) = delete;
+
+        NpyWriter &operator=(const NpyWriter &) = delete;
+
+        ~NpyWriter() {
+            close();
+        }
+
+        /// \param capacity Размер буфера кадров, выделяется один раз: кадры сверх него пишутся в файл сразу
+        void open(const std::string &path, std::string type_descr, std::vector<int> shape, size_t capacity) {
+            file = std::fopen(path.c_str(), "wb");
+            if (file == nullptr) {
+                std::cout << "Error: can`t open file `" << path << "`" << std::endl;
+                exit(-1);
+            }
+            descr = std::move(type_descr);
+            frame_shape = std::move(shape);
+            pending.reserve(capacity);
+            write_header();
+        }
+
+        void append(const char *data, size_t size) {
+            if (pending.size() + size > pending.capacity()) {
+                write_pending();
+            }
+            if (size > pending.capacity()) {
+                std::fwrite(data, 1, size, file);
+            } else {
+                pending.insert(pending.end(), data, data + size);
+            }
+            ++frames;
+        }
+
+        void flush() {
+            if (file == nullptr) {
+                return;
+            }
+            write_pending();
+            write_header();
+            std::fflush(file);
+        }
+
+        void close() {
+            if (file == nullptr) {
+                return;
+            }
+            flush();
+            std::fclose(file);
+            file = nullptr;
+        }
+
+    private:
+        /// Данные без обновления заголовка: до `flush` он описывает меньше кадров, чем записано, и читается как прежде
+        void write_pending() {
+            std::fwrite(pending.data(), 1, pending.size(), file);
+            pending.clear();
+        }
+
+        void write_header() {
+            std::string shape = "(" + std::to_string(frames) + ",";
+            for (int dim: frame_shape) {
+                shape += " " + std::to_string(dim) + ",";
+            }
+            shape += ")";
+            std::string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': " + shape + ", }";
+            header.resize(header_size - 10 - 1, ' ');
+            header += '\n';
+
+            char prefix[10] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0};
+            uint16_t length = header.size();
+            std::memcpy(prefix + 8, &length, sizeof(length));
+
+            long end = std::ftell(file);
+            std::fseek(file, 0, SEEK_SET);
+            std::fwrite(prefix, 1, sizeof(prefix), file);
+            std::fwrite(header.data(), 1, header.size(), file);
+            std::fseek(file, std::max(end, long(header_size)), SEEK_SET);
+        }
+    };
+
+    /// Выгрузка состояния поля. `snapshot` копирует выбранные массивы в буфер в основном потоке, `write` переносит
+    /// снимок в файлы на потоке вывода, пока идут первые фазы следующего тика
+    template<typename T>
+    class FieldExporter {
+        /// Кадры копятся в памяти и сбрасываются на диск пачками примерно такого размера
+        static constexpr size_t batch_size = 4 << 20;
+
+        using p_type = typename T::p_type;
+        using v_type = typename T::v_type;
+        using vf_type = typename T::vf_type;
+
+        T *f;
+        ExportOptions options;
+        int rows = 0;
+        int cols = 0;
+
+        NpyWriter ticks_file, p_file, velocity_file, velocity_flow_file;
+        PageVector<char> p_frame, velocity_frame, velocity_flow_frame;
+        int tick = 0;
+        bool has_snapshot = false;
+        size_t pending_size = 0;
+
+    public:
+        FieldExporter(T &field, ExportOptions export_options) : f(&field), options(std::move(export_options)) {
+            rows = (f->N + options.stride - 1) / options.stride;
+            cols = (f->K + options.stride - 1) / options.stride;
+            const auto &prefix = options.prefix;
+
+            ticks_file.open(prefix + ".ticks.npy", "<i4", {}, batch_size);
+            if (options.p) {
+                using raw = details::npy_type<p_type>;
+                p_file.open(prefix + ".p.npy", raw::descr(), {rows, cols}, batch_size);
+                p_frame.resize(sizeof(typename raw::raw) * rows * cols);
+            }
+            if (options.velocity) {
+                using raw = details::npy_type<v_type>;
+                velocity_file.open(prefix + ".velocity.npy", raw::descr(), {rows, cols, int(deltas.size())},
+                                   batch_size);
+                velocity_frame.resize(sizeof(typename raw::raw) * rows * cols * deltas.size());
+            }
+            if (options.velocity_flow) {
+                using raw = details::npy_type<vf_type>;
+                velocity_flow_file.open(prefix + ".velocity_flow.npy", raw::descr(),
+                                        {rows, cols, int(deltas.size())}, batch_size);
+                velocity_flow_frame.resize(sizeof(typename raw::raw) * rows * cols * deltas.size());
+            }
+            write_description();
+        }
+
+        [[nodiscard]] bool wants(int i) const {
+            return (i + 1) % options.every == 0;
+        }
+
+        void snapshot(int i) {
+            tick = i;
+            if (options.p) {
+                copy<p_type>(p_frame, [this](int x, int y) -> const p_type * { return &f->p[x][y]; }, 1);
+            }
+            if (options.velocity) {
+                copy<v_type>(velocity_frame, [this](int x, int y) { return f->velocity.v[x][y].data(); },
+                             deltas.size());
+            }
+            if (options.velocity_flow) {
+                copy<vf_type>(velocity_flow_frame, [this](int x, int y) { return f->velocity_flow.v[x][y].data(); },
+                              deltas.size());
+            }
+            has_snapshot = true;
+        }
+
+        void write() {
+            if (not has_snapshot) {
+                return;
+            }
+            has_snapshot = false;
+            int32_t value = tick;
+            ticks_file.append(reinterpret_cast<const char *>(&value), sizeof(value));
+            if (options.p) {
+                p_file.append(p_frame.data(), p_frame.size());
+            }
+            if (options.velocity) {
+                velocity_file.append(velocity_frame.data(), velocity_frame.size());
+            }
+            if (options.velocity_flow) {
+                velocity_flow_file.append(velocity_flow_frame.data(), velocity_flow_frame.size());
+            }
+            // Все файлы сбрасываются вместе, чтобы число кадров в них совпадало
+            pending_size += sizeof(value) + p_frame.size() + velocity_frame.size() + velocity_flow_frame.size();
+            if (pending_size >= batch_size) {
+                pending_size = 0;
+                ticks_file.flush();
+                p_file.flush();
+                velocity_file.flush();
+                velocity_flow_file.flush();
+            }
+        }
+
+        void close() {
+            write();
+            ticks_file.close();
+            p_file.close();
+            velocity_file.close();
+            velocity_flow_file.close();
+        }
+
+    private:
+        template<typename Type, typename Getter>
+        void copy(PageVector<char> &frame, Getter get, size_t count) {
+            using raw = details::npy_type<Type>;
+            auto *out = reinterpret_cast<typename raw::raw *>(frame.data());
+            for (int x = 0; x < f->N; x += options.stride) {
+                for (int y = 0; y < f->K; y += options.stride) {
+                    const Type *values = get(x, y);
+                    for (size_t i = 0; i < count; ++i) {
+                        *out++ = raw::get(values[i]);
+                    }
+                }
+            }
+        }
+
+        void write_description() {
+            std::ofstream out(options.prefix + ".json");
+            auto field = [&](const char *name, bool enabled, int frac_bits, bool last) {
+                out << "    \"" << name << "\": " << (enabled ? "{\"frac_bits\": " + std::to_string(frac_bits) + "}"
+                                                             : std::string("null")) << (last ? "\n" : ",\n");
+            };
+            out << "{\n";
+            out << "  \"N\": " << f->N << ",\n  \"K\": " << f->K << ",\n";
+            out << "  \"stride\": " << options.stride << ",\n  \"every\": " << options.every << ",\n";
+            out << "  \"directions\": [[-1, 0], [1, 0], [0, -1], [0, 1]],\n";
+            out << "  \"fields\": {\n";
+            field("p", options.p, details::npy_type<p_type>::frac_bits, false);
+            field("velocity", options.velocity, details::npy_type<v_type>::frac_bits, false);
+            field("velocity_flow", options.velocity_flow, details::npy_type<vf_type>::frac_bits, true);
+            out << "  }\n}\n";
+        }
+    };
+}
@@ -13,90 +13,229 @@
 #include <fstream>
 #include <atomic>
 #include <tuple>
-#include <stack>
+#include <functional>
 
 #include "numbers.h"
+#include "cell_meta.h"
 #include "static_array.h"
 #include "utilities.h"
 #include "vector_field.h"
 #include "tasks.h"
 #include "workers.h"
+#include "flow_solvers.h"
+#include "random_batch.h"
+#include "output_policy.h"
+#include "exporter.h"
+#include "row_partitioner.h"
+#include "embedded_map.h"
+#include "state_view.h"
+#include "cell_profile.h"
 
 
 namespace Emulator {
+    /// Параметры `AbstractField::run`
+    struct RunOptions {
+        /// Номер первого тика: от него считаются кадры вывода, выгрузки и сводки счётчиков
+        int first_tick = 0;
+        /// Через сколько тиков вызывать обратный вызов прогресса, 0 - только после последнего
+        int progress_every = 0;
+    };
+
     struct AbstractField {
         virtual void next(int) = 0;
 
+        /// Выполняет `ticks` тиков подряд внутри поля, без виртуального вызова на каждый тик
+        /// \param progress Вызывается с номером только что выполненного тика с шагом `options.progress_every`
+        virtual void run(int ticks, const RunOptions &options, const std::function<void(int)> &progress = {}) = 0;
+
         virtual void load(const std::string &) = 0;
 
+        /// Загружает карту из потока в том же формате, что и файл
+        virtual void load(std::istream &) = 0;
+
         virtual ~AbstractField() = default;
 
         virtual void init_workers(int) = 0;
+
+        virtual void set_flow_solver(FlowSolverKind) = 0;
+
+        virtual void set_flow_warm_start(bool) = 0;
+
+        /// Генератор и seed фазы перемещения (по умолчанию mt19937 и 1337), можно задавать и до, и после `load`.
+        /// Последовательность чисел начинается заново с этого seed
+        virtual void set_random(RandomKind, uint64_t seed) = 0;
+
+        virtual void set_output(const OutputPolicy &) = 0;
+
+        virtual void set_export(const ExportOptions &) = 0;
+
+        /// Запоминать сумму `p` после каждого тика и вывести весь журнал в `finish`
+        virtual void set_pressure_log(bool) = 0;
+
+        /// Вывести в `finish` разбиение строк по потокам для параллельных фаз
+        virtual void set_stats(bool) = 0;
+
+        /// Считать заходы обходов в каждую клетку и выгрузить их в `finish` в файлы с префиксом `prefix`
+        /// (см. `CellProfile`), пустой префикс - не считать. Вызывать после `load`
+        virtual void set_heatmap(const std::string &prefix) = 0;
+
+        /// Дожидается вывода последнего кадра, для `--output=final` выводит итоговое поле
+        virtual void finish() = 0;
+
+        /// Массив состояния без копирования, см. `StateView`
+        virtual StateView view(StateArray) = 0;
     };
 
-    template<typename PType, typename VType, typename VFType, int N_val, int K_val>
+    /// \tparam Layout Раскладка в памяти массивов, по которым ходят `propagate_*` (`meta`, `velocity`, `velocity_flow`)
+    /// \tparam Map `EmbeddedMap` с расположением стен, известным при компиляции, или void
+    template<typename PType, typename VType, typename VFType, int N_val, int K_val, typename Layout = RowMajor,
+            typename Map = void>
     class FieldEmulator : public AbstractField {
         using p_type = PType;
         using v_type = VType;
         using vf_type = VFType;
-        using full_type = FieldEmulator<PType, VType, VFType, N_val, K_val>;
+        using full_type = FieldEmulator<PType, VType, VFType, N_val, K_val, Layout, Map>;
+
+        static constexpr bool embedded = not std::is_void_v<Map>;
 
         int N = 0;
         int K = 0;
 
         Array<char, N_val, K_val> field{};
 
-        VectorField<VType, N_val, K_val> velocity = {};
-        VectorField<VFType, N_val, K_val> velocity_flow = {};
+        VectorField<VType, N_val, K_val, Layout> velocity = {};
+        VectorField<VFType, N_val, K_val, Layout> velocity_flow = {};
 
-        Array<int64_t, N_val, K_val> dirs{};
-        Array<int64_t, N_val, K_val> last_use{};
+        Array<CellMeta, N_val, K_val, Layout> meta{};
         int UT = 0;
-        int last_active = 0;
+
+        /// Кадр явного стека `propagate_flow`
+        struct FlowFrame {
+            int x, y;
+            int dir;
+            VFType lim, ret, vp;
+        };
+
+        /// Кадр явного стека `propagate_move`
+        struct MoveFrame {
+            int x, y;
+            int nx, ny;
+            bool is_first;
+        };
+
+        PageVector<FlowFrame> flow_path;
+        PageVector<MoveFrame> move_path;
+        PageVector<std::pair<int, int>> stop_path;
+
+        FlowSolverKind flow_solver = FlowSolverKind::dfs;
+        std::unique_ptr<FlowEngine> flow_engine;
+        bool flow_warm_start = false;
+        std::unique_ptr<FlowWarmStart<full_type>> flow_repair;
+
+        RandomBatch random;
+        RandomKind random_kind = RandomKind::mt19937;
+        uint64_t random_seed = 1337;
+        int last_tick = -1;
+        int output_tick = 0;
+        bool print_pending = false;
+        OutputPolicy output{};
+        std::unique_ptr<FieldExporter<full_type>> exporter;
+        bool log_p = false;
+        std::vector<double> p_log;
 
         PType rho[256];
         Array<PType, N_val, K_val> p{}, old_p{};
 
-        Array<std::mutex, N_val, K_val> p_mutex{};
+        /// Вклады клеток в `p` за пересчёт (`RecalcPTask`) по направлениям и маска направлений, где они есть.
+        /// `GatherPTask` собирает их в `p` в последовательном порядке
+        Array<std::array<PType, 4>, N_val, K_val> p_out{};
+        Array<uint8_t, N_val, K_val> p_out_mask{};
+
+        /// Массивы отображены из файлов (`MemoryPolicy::backing_dir`), обходы по строкам подчитывают их заранее
+        bool out_of_core = false;
+        static constexpr int prefetch_chunk = 16;
 
         std::vector<std::unique_ptr<Task>> g_tasks;
         std::vector<std::unique_ptr<Task>> p_tasks;
         std::vector<std::unique_ptr<Task>> recalc_p_tasks;
+        std::vector<std::unique_ptr<Task>> gather_p_tasks;
+        RowPartitioner g_rows{};
+        RowPartitioner p_rows{};
+        RowPartitioner recalc_p_rows{};
+        RowPartitioner gather_p_rows{};
+        bool stats = false;
+        CellProfile profile;
         std::vector<std::unique_ptr<Task>> output_field_task;
+        std::vector<std::unique_ptr<Task>> random_task;
 
         WorkerHandler main_handler{};
         WorkerHandler output_handler{};
+        WorkerHandler random_handler{};
     public:
         constexpr FieldEmulator() = default;
 
         void next(int i) override {
-            apply_external_forces();
-
-            apply_p_forces();
-
-            apply_forces_on_flow();
+            tick(i);
+        }
 
-            recalculate_p();
+        void run(int ticks, const RunOptions &options, const std::function<void(int)> &progress) override {
+            int every = options.progress_every > 0 ? options.progress_every : ticks;
+            for (int i = options.first_tick; i < options.first_tick + ticks; ++i) {
+                tick(i);
+                if (progress and ((i - options.first_tick + 1) % every == 0 or i + 1 == options.first_tick + ticks)) {
+                    progress(i);
+                }
+            }
+        }
 
+        void finish() override {
+            if (output.mode() == OutputPolicy::Mode::final and last_tick >= 0) {
+                output_handler.wait_until_end();
+                schedule_output(last_tick, true);
+            }
             output_handler.wait_until_end();
-
-            bool prop = apply_move_on_flow();
-
-            if (prop) {
-                last_active = i;
-                output_handler.set_tasks(&output_field_task);
+            PerfCounters::finish(last_tick);
+            if (stats and main_handler.is_initialized()) {
+                std::cout << "Row partitioning:\n";
+                g_rows.report(std::cout, "apply_external_forces");
+                p_rows.report(std::cout, "apply_p_forces");
+                recalc_p_rows.report(std::cout, "recalculate_p");
+                gather_p_rows.report(std::cout, "gather_p");
             }
+            if (exporter) {
+                exporter->close();
+            }
+            profile.write([this](int x, int y) { return field[x][y]; });
+            for (size_t i = 0; i < p_log.size(); ++i) {
+                std::cout << "Pressure " << i << " " << std::setprecision(12) << p_log[i] << "\n";
+            }
+            std::cout.flush();
         }
 
         void load(const std::string &filename) override {
             std::ifstream file(filename);
-            int t;
             if (not file.is_open()) {
                 std::cout << "Error: can`t open file `" << filename << "`" << std::endl;
             }
-            file >> N >> K >> t >> UT;
-            load_array(field, file, N, K);
-            init();
+            load(file, filename);
+        }
+
+        void load(std::istream &file) override {
+            load(file, "<stream>");
+        }
+
+        StateView view(StateArray array) override {
+            switch (array) {
+                case StateArray::field:
+                    return StateView::of<char>(field, N, K);
+                case StateArray::p:
+                    return StateView::of<PType>(p, N, K);
+                case StateArray::velocity:
+                    return StateView::of<VType, deltas.size()>(velocity.v, N, K);
+                case StateArray::velocity_flow:
+                    return StateView::of<VFType, deltas.size()>(velocity_flow.v, N, K);
+            }
+            return {};
         }
 
         void init_workers(int n) override {
@@ -104,7 +243,63 @@ namespace Emulator {
                 throw std::runtime_error("Must be at least 1 thread");
             }
             main_handler.init(n);
-            output_handler.init(1);
+            random_handler.init(1, "random");
+
+            // Начальная стоимость строки - число клеток без стен, единица добавлена, чтобы строки из одних стен
+            // тоже попадали в полосы пропорционально
+            std::vector<double> weights(N, 1);
+            for (int x = 0; x < N; ++x) {
+                auto [begin, end] = open_columns(x);
+                for (int y = begin; y < end; ++y) {
+                    weights[x] += not is_wall(x, y);
+                }
+            }
+            for (auto [tasks, rows]: {std::pair{&g_tasks, &g_rows}, {&p_tasks, &p_rows},
+                                      {&recalc_p_tasks, &recalc_p_rows}, {&gather_p_tasks, &gather_p_rows}}) {
+                rows->init(weights, n);
+                assign_rows(*tasks, *rows);
+            }
+        }
+
+        void set_flow_solver(FlowSolverKind kind) override {
+            flow_solver = kind;
+            flow_engine.reset();
+        }
+
+        void set_flow_warm_start(bool warm) override {
+            flow_warm_start = warm;
+        }
+
+        void set_random(RandomKind kind, uint64_t seed) override {
+            random_kind = kind;
+            random_seed = seed;
+            // До `load` размер поля может быть ещё неизвестен, тогда генератор заводит `init`
+            if (not random_task.empty()) {
+                random.init(2 * N * K, random_kind, random_seed);
+            }
+        }
+
+        void set_output(const OutputPolicy &policy) override {
+            output = policy;
+        }
+
+        void set_pressure_log(bool enabled) override {
+            log_p = enabled;
+        }
+
+        void set_stats(bool enabled) override {
+            stats = enabled;
+        }
+
+        void set_heatmap(const std::string &prefix) override {
+            profile.init(prefix, N, K);
+        }
+
+        void set_export(const ExportOptions &options) override {
+            exporter.reset();
+            if (options.enabled()) {
+                exporter = std::make_unique<FieldExporter<full_type>>(*this, options);
+            }
         }
 
         friend class ApplyGTask<full_type>;
@@ -113,127 +308,362 @@ namespace Emulator {
 
         friend class RecalcPTask<full_type>;
 
+        friend class GatherPTask<full_type>;
+
         friend class OutFieldTask<full_type>;
 
+        friend class ExportTask<full_type>;
+
+        friend class FieldExporter<full_type>;
+
+        friend class RandomFillTask<full_type>;
+
+        friend class ResidualFlowEngine<full_type>;
+
+        friend class FlowWarmStart<full_type>;
+
     private:
-        void update_p(int x, int y, const PType &val) {
-            std::lock_guard lock(p_mutex[x][y]);
-            p[x][y] += val;
+        /// \param source Имя карты для сообщений об ошибках
+        void load(std::istream &file, const std::string &source) {
+            int t;
+            file >> N >> K >> t >> UT;
+            if constexpr (N_val > 0) {
+                if (N > N_val or K > K_val) {
+                    std::cout << "Error: field " << N << "x" << K << " does not fit into " << N_val << "x" << K_val
+                              << std::endl;
+                    exit(-1);
+                }
+            }
+            load_array(field, file, N, K);
+            if constexpr (N_val > 0) {
+                // Поле меньше ёмкости массивов: лишние клетки - стены, обходы до них не доходят
+                for (int x = 0; x < N_val; ++x) {
+                    for (int y = x < N ? K : 0; y < K_val; ++y) {
+                        field[x][y] = '#';
+                    }
+                }
+            }
+            if constexpr (embedded) {
+                static_assert(N_val == Map::N and K_val == Map::K);
+                for (int x = 0; x < N; ++x) {
+                    for (int y = 0; y < K; ++y) {
+                        if ((field[x][y] == '#') != Map::wall(x, y)) {
+                            std::cout << "Error: walls of `" << source << "` differ from the embedded map `"
+                                      << Map::name << "`" << std::endl;
+                            exit(-1);
+                        }
+                    }
+                }
+            }
+            init();
+        }
+
+        /// Один тик: фазы, журнал `p`, счётчики и запуск вывода кадра
+        void tick(int i) {
+            bool prop = step();
+            last_tick = i;
+
+            if (log_p) {
+                log_pressure();
+            }
+            PerfCounters::end_tick(i);
+
+            bool print = output.should_output(i, prop);
+            bool dump = exporter and exporter->wants(i);
+            if (dump) {
+                TraceScope trace("export_snapshot", "output");
+                exporter->snapshot(i);
+            }
+            if (print or dump) {
+                schedule_output(i, print);
+            }
+        }
+
+        /// Фазы одного тика, возвращает, сдвинулась ли хоть одна клетка
+        bool step() {
+            TraceScope trace("tick", "tick");
+            random_handler.set_tasks(&random_task);
+
+            apply_external_forces();
+
+            apply_p_forces();
+
+            apply_forces_on_flow();
+
+            recalculate_p();
+
+            {
+                TraceScope wait("wait_output", "wait");
+                output_handler.wait_until_end();
+            }
+            {
+                TraceScope wait("wait_random", "wait");
+                random_handler.wait_until_end();
+            }
+
+            return apply_move_on_flow();
+        }
+
+        /// Поток вывода создаётся при первом кадре, так что при `--output=none` без выгрузки его нет вовсе
+        void schedule_output(int tick, bool print) {
+            if (not output_handler.is_initialized()) {
+                output_handler.init(1, "output");
+            }
+            output_tick = tick;
+            print_pending = print;
+            output_handler.set_tasks(&output_field_task);
+        }
+
+        void log_pressure() {
+            double sum = 0;
+            for (int x = 0; x < N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    sum += double(p[x][y]);
+                }
+            }
+            p_log.push_back(sum);
+        }
+
+        /// На первой строке каждой пачки из `prefetch_chunk` строк просит ядро асинхронно подчитать с диска следующую
+        /// пачку всех массивов состояния. Обходы идут по строкам, так что к её началу страницы уже в памяти
+        void prefetch_ahead(int x) {
+            if (not out_of_core or x % prefetch_chunk != 0) {
+                return;
+            }
+            int begin = x + prefetch_chunk;
+            int end = std::min(N, begin + prefetch_chunk);
+            if (begin >= end) {
+                return;
+            }
+            field.advise_rows(begin, end, MADV_WILLNEED);
+            velocity.v.advise_rows(begin, end, MADV_WILLNEED);
+            velocity_flow.v.advise_rows(begin, end, MADV_WILLNEED);
+            meta.advise_rows(begin, end, MADV_WILLNEED);
+            p.advise_rows(begin, end, MADV_WILLNEED);
+            old_p.advise_rows(begin, end, MADV_WILLNEED);
+            p_out.advise_rows(begin, end, MADV_WILLNEED);
+            p_out_mask.advise_rows(begin, end, MADV_WILLNEED);
+        }
+
+        /// Стены не двигаются, поэтому для встроенной карты это константа
+        [[nodiscard]] bool is_wall(int x, int y) {
+            if constexpr (embedded) {
+                return Map::wall(x, y);
+            } else {
+                return field[x][y] == '#';
+            }
+        }
+
+        /// Столбцы [begin, end) строки `x`, вне которых только стены. Для встроенной карты строки из стен пропускаются
+        [[nodiscard]] std::pair<int, int> open_columns(int x) {
+            if constexpr (embedded) {
+                return Map::columns[x];
+            } else {
+                return {0, K};
+            }
         }
 
         void init() {
             velocity.v.init(N, K);
-            last_use.init(N, K);
             velocity_flow.v.init(N, K);
-            dirs.init(N, K);
+            meta.init(N, K);
 
             p.init(N, K);
             old_p.init(N, K);
-            p_mutex.init(N, K);
+            p_out.init(N, K);
+            p_out_mask.init(N, K);
+            out_of_core = not MemoryPolicy::backing_dir.empty();
+
+            // Глубина всех обходов не превышает числа клеток: клетка попадает на стек лишь однажды
+            flow_path.reserve(N * K + 1);
+            move_path.reserve(N * K + 1);
+            stop_path.reserve(N * K + 1);
 
             g_tasks.reserve(N);
             p_tasks.reserve(N);
             recalc_p_tasks.reserve(N);
+            gather_p_tasks.reserve(N);
+            // По задаче на строку - наибольшее возможное число полос, `RowPartitioner` задаёт границы первых из них
             for (int i = 0; i < N; i++) {
-                g_tasks.push_back(std::make_unique<ApplyGTask<full_type>>(i, *this));
-                p_tasks.push_back(std::make_unique<ApplyPTask<full_type>>(i, *this));
-                recalc_p_tasks.push_back(std::make_unique<RecalcPTask<full_type>>(i, *this));
+                g_tasks.push_back(std::make_unique<ApplyGTask<full_type>>(i, i + 1, *this));
+                p_tasks.push_back(std::make_unique<ApplyPTask<full_type>>(i, i + 1, *this));
+                recalc_p_tasks.push_back(std::make_unique<RecalcPTask<full_type>>(i, i + 1, *this));
+                gather_p_tasks.push_back(std::make_unique<GatherPTask<full_type>>(i, i + 1, *this));
             }
 
             output_field_task.push_back(std::make_unique<OutFieldTask<full_type>>(*this));
+            output_field_task.push_back(std::make_unique<ExportTask<full_type>>(*this));
+            random_task.push_back(std::make_unique<RandomFillTask<full_type>>(*this));
+            random.init(2 * N * K, random_kind, random_seed);
 
             rho[' '] = 0.01;
             rho['.'] = int64_t(1000);
+            if constexpr (embedded) {
+                for (int x = 0; x < N; ++x) {
+                    for (int y = 0; y < K; ++y) {
+                        meta[x][y] = Map::meta[x * K + y];
+                    }
+                }
+                return;
+            }
             for (int x = 0; x < N; ++x) {
                 for (int y = 0; y < K; ++y) {
-                    if (field[x][y] == '#')
+                    if (field[x][y] == '#') {
+                        meta[x][y].set(true, 0);
                         continue;
-                    for (auto [dx, dy]: deltas) {
-                        dirs[x][y] += (field[x + dx][y + dy] != '#');
                     }
+                    uint8_t open = 0;
+                    for_each_direction([&](auto dir) {
+                        open |= (field[x + dir.dx][y + dir.dy] != '#') << dir.index;
+                    });
+                    meta[x][y].set(false, open);
                 }
             }
         }
 
-        std::tuple<VFType, bool, std::pair<int, int>> propagate_flow(int x, int y, VFType lim) {
-            last_use[x][y] = UT - 1;
-            VFType ret{};
-            for (auto [dx, dy]: deltas) {
-                int nx = x + dx, ny = y + dy;
-                if (field[nx][ny] == '#' || last_use[nx][ny] >= UT) {
-                    continue;
+        /// Переход к новой эпохе обхода. Все отметки `last_use` к этому моменту не больше старой `UT`, поэтому при
+        /// переполнении их можно обнулить без изменения результатов сравнений с `UT` и `UT - 1`
+        void next_epoch() {
+            if (UT > max_epoch - 2) {
+                for (int x = 0; x < N; ++x) {
+                    for (int y = 0; y < K; ++y) {
+                        meta[x][y].last_use = 0;
+                    }
                 }
-                VType cap = velocity.get(x, y, dx, dy);
-                VFType flow = velocity_flow.get(x, y, dx, dy);
-                if (fabs(flow - VFType(cap)) <= 0.0001) {
+                UT = 0;
+            }
+            UT += 2;
+        }
+
+        /// Итеративный поиск цикла скоростей из клетки (x0, y0). Стек `flow_path` повторяет стек вызовов прежней
+        /// рекурсивной версии, поэтому порядок обхода и насыщения рёбер не изменился
+        /// \return Величина потока, нужно ли продолжать насыщение выше по стеку и клетка, на которой замкнулся цикл
+        std::tuple<VFType, bool, std::pair<int, int>> propagate_flow(int x0, int y0, VFType lim0) {
+            flow_path.clear();
+            auto enter = [this](int x, int y, VFType lim) {
+                meta[x][y].last_use = UT - 1;
+                profile.add(CellProfile::flow_visits, x, y);
+                flow_path.push_back({x, y, 0, lim, VFType{}, VFType{}});
+            };
+            enter(x0, y0, lim0);
+
+            VFType t{};
+            bool prop = false;
+            std::pair<int, int> end{-1, -1};
+            bool returned = false;
+            while (true) {
+                auto &f = flow_path.back();
+                auto &cell = meta[f.x][f.y];
+                bool leave = false, descended = false;
+                if (returned) {
+                    returned = false;
+                    auto [dx, dy] = deltas[f.dir];
+                    int nx = f.x + dx, ny = f.y + dy;
+                    if (end == std::pair(nx, ny)) {
+                        enter(nx, ny, f.vp);
+                        continue;
+                    }
+                    f.ret += t;
+                    if (prop) {
+                        velocity_flow.add(f.x, f.y, f.dir, t);
+                        profile.add(CellProfile::flow_augmentations, f.x, f.y);
+                        prop = end != std::pair(f.x, f.y);
+                        leave = true;
+                    } else {
+                        ++f.dir;
+                    }
+                }
+                for (; not leave and f.dir < int(deltas.size()); ++f.dir) {
+                    auto [dx, dy] = deltas[f.dir];
+                    int nx = f.x + dx, ny = f.y + dy;
+                    if (!cell.open(f.dir) || meta[nx][ny].last_use >= UT) {
+                        continue;
+                    }
+                    VType cap = velocity.get(f.x, f.y, f.dir);
+                    VFType flow = velocity_flow.get(f.x, f.y, f.dir);
+                    if (fabs(flow - VFType(cap)) <= 0.0001) {
+                        continue;
+                    }
+                    VFType vp = std::min(f.lim, VFType(cap) - flow);
+                    if (meta[nx][ny].last_use == UT - 1) {
+                        velocity_flow.add(f.x, f.y, f.dir, vp);
+                        profile.add(CellProfile::flow_augmentations, f.x, f.y);
+                        t = vp;
+                        prop = true;
+                        end = {nx, ny};
+                        leave = true;
+                        break;
+                    }
+                    f.vp = vp;
+                    enter(nx, ny, vp);
+                    descended = true;
+                    break;
+                }
+                if (descended) {
                     continue;
                 }
-                VFType vp = std::min(lim, VFType(cap) - flow);
-                if (last_use[nx][ny] == UT - 1) {
-                    velocity_flow.add(x, y, dx, dy, vp);
-                    last_use[x][y] = UT;
-                    return {vp, true, {nx, ny}};
+                if (not leave) {
+                    t = f.ret;
+                    prop = false;
+                    end = {-1, -1};
                 }
-                VFType t;
-                bool prop;
-                std::pair<int, int> end;
-                do {
-                    std::tie(t, prop, end) = propagate_flow(nx, ny, vp);
-                } while (end == std::pair(nx, ny));
-                ret += t;
-                if (prop) {
-                    velocity_flow.add(x, y, dx, dy, t);
-                    last_use[x][y] = UT;
-                    return {t, end != std::pair(x, y), end};
+                cell.last_use = UT;
+                flow_path.pop_back();
+                if (flow_path.empty()) {
+                    return {t, prop, end};
                 }
+                returned = true;
             }
-            last_use[x][y] = UT;
-            return {ret, false, {-1, -1}};
         }
 
         inline bool is_stoppable(int x, int y) {
-            for (auto [dx, dy]: deltas) {
-                int nx = x + dx, ny = y + dy;
-                if (field[nx][ny] != '#' && last_use[nx][ny] < UT - 1 && velocity.get(x, y, dx, dy) > int64_t(0)) {
-                    return false;
-                }
-            }
-            return true;
+            const auto &cell = meta[x][y];
+            return not for_each_direction([&](auto dir) {
+                int nx = x + dir.dx, ny = y + dir.dy;
+                return cell.open(dir.index) && meta[nx][ny].last_use < UT - 1 && velocity.get(x, y, dir) > int64_t(0);
+            });
         }
 
         void propagate_stop(int x_, int y_) {
-            std::stack<std::pair<int, int>> nxt;
-            nxt.emplace(x_, y_);
-            last_use[x_][y_] = UT;
-            while (not nxt.empty()) {
-                auto [x, y] = nxt.top();
-                nxt.pop();
-                for (auto [dx, dy]: deltas) {
-                    int nx = x + dx, ny = y + dy;
-                    if (field[nx][ny] == '#' || last_use[nx][ny] == UT || velocity.get(x, y, dx, dy) > int64_t(0) ||
+            // `propagate_stop` не вызывает себя, поэтому её стек - один на поле и только очищается между вызовами
+            stop_path.clear();
+            stop_path.emplace_back(x_, y_);
+            meta[x_][y_].last_use = UT;
+            profile.add(CellProfile::stop_visits, x_, y_);
+            while (not stop_path.empty()) {
+                auto [x, y] = stop_path.back();
+                stop_path.pop_back();
+                const auto &cell = meta[x][y];
+                for_each_direction([&](auto dir) {
+                    int nx = x + dir.dx, ny = y + dir.dy;
+                    if (!cell.open(dir.index) || meta[nx][ny].last_use == UT || velocity.get(x, y, dir) > int64_t(0) ||
                         not is_stoppable(nx, ny)) {
-                        continue;
+                        return;
                     }
-                    last_use[nx][ny] = UT;
-                    nxt.emplace(nx, ny);
-                }
+                    meta[nx][ny].last_use = UT;
+                    profile.add(CellProfile::stop_visits, nx, ny);
+                    stop_path.emplace_back(nx, ny);
+                });
             }
         }
 
-        VType move_probability(int x, int y) {
+        /// Префиксные суммы неотрицательных скоростей к соседям, ещё не отмеченным `UT`. Последний элемент - вероятность
+        /// сдвинуть клетку
+        std::array<VType, deltas.size()> move_table(int x, int y) {
+            std::array<VType, deltas.size()> tres;
             VType sum{};
-            for (auto [dx, dy]: deltas) {
-                int nx = x + dx, ny = y + dy;
-                if (field[nx][ny] == '#' || last_use[nx][ny] == UT) {
-                    continue;
-                }
-                VType v = velocity.get(x, y, dx, dy);
-                if (v < int64_t(0)) {
-                    continue;
+            const auto &cell = meta[x][y];
+            for_each_direction([&](auto dir) {
+                int nx = x + dir.dx, ny = y + dir.dy;
+                if (cell.open(dir.index) && meta[nx][ny].last_use != UT) {
+                    const VType &v = velocity.get(x, y, dir);
+                    if (v >= int64_t(0)) {
+                        sum += v;
+                    }
                 }
-                sum += v;
-            }
-            return sum;
+                tres[dir.index] = sum;
+            });
+            return tres;
         }
 
         void swap(int x1, int y1, int x2, int y2) {
@@ -242,79 +672,110 @@ namespace Emulator {
             std::swap(velocity.v[x1][y1], velocity.v[x2][y2]);
         }
 
-        bool propagate_move(int x, int y, bool is_first) {
-            last_use[x][y] = UT - is_first;
+        /// Итеративное случайное блуждание из клетки (x0, y0) с тем же порядком выборов, что и у прежней рекурсивной
+        /// версии. Кадр на вершине `move_path` после возврата из потомка либо завершается, либо делает новую попытку
+        /// \param first_table Уже посчитанная `move_table(x0, y0)`: до первого выбора соседи клетки не меняются
+        bool propagate_move(int x0, int y0, bool is_first, const std::array<VType, deltas.size()> *first_table = nullptr) {
+            move_path.clear();
+            auto enter = [this](int x, int y, bool first) {
+                meta[x][y].last_use = UT - first;
+                profile.add(CellProfile::move_visits, x, y);
+                move_path.push_back({x, y, -1, -1, first});
+            };
+            enter(x0, y0, is_first);
+
             bool ret = false;
-            int nx = -1, ny = -1;
-            do {
-                std::array<VType, deltas.size()> tres;
-                VType sum{};
-                for (size_t i = 0; i < deltas.size(); ++i) {
-                    auto [dx, dy] = deltas[i];
-                    int forward_x = x + dx, forward_y = y + dy;
-                    if (field[forward_x][forward_y] == '#' || last_use[forward_x][forward_y] == UT) {
-                        tres[i] = sum;
-                        continue;
-                    }
-                    VType v = velocity.get(x, y, dx, dy);
-                    if (v < int64_t(0)) {
-                        tres[i] = sum;
-                        continue;
+            bool returned = false;
+            while (true) {
+                auto &f = move_path.back();
+                auto &cell = meta[f.x][f.y];
+                if (not returned or not ret) {
+                    ret = false;
+                    // Повторная попытка после неудачного потомка: он и часть соседей уже отмечены `UT`
+                    auto tres = first_table ? *first_table : move_table(f.x, f.y);
+                    first_table = nullptr;
+                    const VType &sum = tres.back();
+
+                    if (sum != int64_t(0)) {
+                        VType random_num = random.next01<VType>() * sum;
+                        size_t d = std::ranges::upper_bound(tres, random_num) - tres.begin();
+
+                        auto [dx, dy] = deltas[d];
+                        f.nx = f.x + dx;
+                        f.ny = f.y + dy;
+                        if (meta[f.nx][f.ny].last_use != UT - 1) {
+                            returned = false;
+                            enter(f.nx, f.ny, false);
+                            continue;
+                        }
+                        ret = true;
                     }
-                    sum += v;
-                    tres[i] = sum;
-                }
-
-                if (sum == int64_t(0)) {
-                    break;
                 }
+                returned = false;
 
-                VType random_num = random01<VType>() * sum;
-                size_t d = std::ranges::upper_bound(tres, random_num) - tres.begin();
+                cell.last_use = UT;
 
-                auto [dx, dy] = deltas[d];
-                nx = x + dx;
-                ny = y + dy;
-                ret = (last_use[nx][ny] == UT - 1 || propagate_move(nx, ny, false));
-            } while (!ret);
-
-            last_use[x][y] = UT;
-
-            for (auto [dx, dy]: deltas) {
-                int forward_x = x + dx, forward_y = y + dy;
-                if (field[forward_x][forward_y] != '#' and last_use[forward_x][forward_y] < UT - 1 and
-                    velocity.get(x, y, dx, dy) < int64_t(0) and is_stoppable(forward_x, forward_y)) {
-                    propagate_stop(forward_x, forward_y);
+                for_each_direction([&](auto dir) {
+                    int forward_x = f.x + dir.dx, forward_y = f.y + dir.dy;
+                    if (cell.open(dir.index) and meta[forward_x][forward_y].last_use < UT - 1 and
+                        velocity.get(f.x, f.y, dir) < int64_t(0) and is_stoppable(forward_x, forward_y)) {
+                        propagate_stop(forward_x, forward_y);
+                    }
+                });
+                if (ret and !f.is_first) {
+                    swap(f.x, f.y, f.nx, f.ny);
                 }
+                move_path.pop_back();
+                if (move_path.empty()) {
+                    return ret;
+                }
+                returned = true;
             }
-            if (ret and !is_first) {
-                swap(x, y, nx, ny);
-            }
-            return ret;
         }
 
         void apply_external_forces() {
-            main_handler.set_tasks(&g_tasks);
-            main_handler.wait_until_end();
+            TraceScope trace("apply_external_forces", "phase");
+            run_rows(g_tasks, g_rows);
         }
 
         void apply_p_forces() {
+            TraceScope trace("apply_p_forces", "phase");
             old_p = p;
-            main_handler.set_tasks(&p_tasks);
-            main_handler.wait_until_end();
+            run_rows(p_tasks, p_rows);
         }
 
         void apply_forces_on_flow() {
-            velocity_flow.v.clear();
+            TraceScope trace("apply_forces_on_flow", "phase");
+            // Тёплый старт сокращает только число насыщений: `g` каждый тик меняет ёмкость вниз у всех клеток без
+            // стен, поэтому и проверка потока, и поиск циклов по-прежнему проходят всё поле
+            if (flow_warm_start) {
+                if (not flow_repair) {
+                    flow_repair = std::make_unique<FlowWarmStart<full_type>>(*this);
+                }
+                if (not flow_repair->repair()) {
+                    velocity_flow.v.clear();
+                }
+            } else {
+                velocity_flow.v.clear();
+            }
+            if (flow_solver != FlowSolverKind::dfs) {
+                if (not flow_engine) {
+                    flow_engine = make_flow_engine();
+                }
+                flow_engine->solve();
+                return;
+            }
             int cnt = 0;
             bool prop;
             do {
                 cnt++;
-                UT += 2;
+                next_epoch();
                 prop = false;
                 for (int x = 0; x < N; x++) {
-                    for (int y = 0; y < K; y++) {
-                        if (field[x][y] == '#' or last_use[x][y] == UT) {
+                    prefetch_ahead(x);
+                    auto [begin, end] = open_columns(x);
+                    for (int y = begin; y < end; y++) {
+                        if (meta[x][y].is_wall() or meta[x][y].last_use == UT) {
                             continue;
                         }
                         auto [t, _unused1, _unused2] = propagate_flow(x, y, int64_t(1));
@@ -327,20 +788,51 @@ namespace Emulator {
             } while (prop);
         }
 
+        std::unique_ptr<FlowEngine> make_flow_engine() {
+            if (flow_solver == FlowSolverKind::dinic) {
+                return std::make_unique<DinicFlowEngine<full_type>>(*this);
+            }
+            return std::make_unique<PushRelabelFlowEngine<full_type>>(*this);
+        }
+
         void recalculate_p() {
-            main_handler.set_tasks(&recalc_p_tasks);
+            TraceScope trace("recalculate_p", "phase");
+            run_rows(recalc_p_tasks, recalc_p_rows);
+            run_rows(gather_p_tasks, gather_p_rows);
+        }
+
+        /// Раздаёт потокам полосы строк и уточняет разбиение по замерам фазы
+        void run_rows(std::vector<std::unique_ptr<Task>> &tasks, RowPartitioner &rows) {
+            auto start = std::chrono::steady_clock::now();
+            main_handler.set_tasks(&tasks, rows.chunks());
             main_handler.wait_until_end();
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            if (rows.update([&tasks](int i) { return static_cast<RowTask &>(*tasks[i]).elapsed; }, elapsed)) {
+                assign_rows(tasks, rows);
+            }
+        }
+
+        static void assign_rows(std::vector<std::unique_ptr<Task>> &tasks, const RowPartitioner &rows) {
+            for (int i = 0; i < rows.chunks(); ++i) {
+                auto &task = static_cast<RowTask &>(*tasks[i]);
+                task.begin = rows.begin(i);
+                task.end = rows.end(i);
+            }
         }
 
         bool apply_move_on_flow() {
-            UT += 2;
+            TraceScope trace("apply_move_on_flow", "phase");
+            next_epoch();
             bool prop = false;
             for (int x = 0; x < N; ++x) {
-                for (int y = 0; y < K; ++y) {
-                    if (field[x][y] != '#' && last_use[x][y] != UT) {
-                        if (random01<VType>() < move_probability(x, y)) {
+                prefetch_ahead(x);
+                auto [begin, end] = open_columns(x);
+                for (int y = begin; y < end; ++y) {
+                    if (!meta[x][y].is_wall() && meta[x][y].last_use != UT) {
+                        auto tres = move_table(x, y);
+                        if (random.next01<VType>() < tres.back()) {
                             prop = true;
-                            propagate_move(x, y, true);
+                            propagate_move(x, y, true, &tres);
                         } else {
                             propagate_stop(x, y);
                         }
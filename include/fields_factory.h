@@ -11,6 +11,11 @@
 
 #include "field.h"
 
+// Генерируется CMake из `FLUID_MAPS` и определяет `MAPS`
+#if __has_include("embedded_maps.h")
+#include "embedded_maps.h"
+#endif
+
 #ifndef TYPES
 #error "Not defined any types"
 #endif
@@ -19,6 +24,14 @@
 #define SIZES
 #endif
 
+#ifndef MAPS
+#define MAPS
+#endif
+
+#ifndef FIELD_LAYOUT
+#define FIELD_LAYOUT RowMajor
+#endif
+
 #define FLOAT {"FLOAT", 1}
 #define DOUBLE {"DOUBLE", 2}
 #define FIXED(n, k) {"FIXED("#n","#k")", (n*1000 + k)}
@@ -29,6 +42,10 @@ namespace Emulator {
         static const inline std::map<std::string, int> encoded_ = {TYPES};
 
     public:
+        [[nodiscard]] static bool has_type(const std::string &name) {
+            return encoded_.contains(name);
+        }
+
         static int get_type(const std::string &name) {
             if (not encoded_.contains(name)) {
                 std::cout << "Error: type `" << name << "` not found" << std::endl;
@@ -71,23 +88,66 @@ namespace Emulator {
     template<int n>
     using get_type = details::get_type_impl<n>::type;
 
-    /// В compile-time заполняет массив из ВСЕХ ВОЗМОЖНЫХ комбинации 3-х типов данных и размеров поля(включая "динамический")
-    /// \return Массив из пятерок int: первые 3 - типы данных, последние 2 - размеры поля
+    /// Встроенные при сборке карты
+    using embedded_maps = std::tuple<MAPS>;
+
+    namespace details {
+        template<int idx>
+        struct get_map_impl {
+            using type = EmbeddedMap<std::tuple_element_t<idx, embedded_maps>>;
+        };
+
+        template<>
+        struct get_map_impl<-1> {
+            using type = void;
+        };
+
+        template<size_t... idx>
+        constexpr auto map_sizes(std::index_sequence<idx...>) {
+            return std::array<std::pair<int, int>, sizeof...(idx)>{
+                    std::pair(get_map_impl<idx>::type::N, get_map_impl<idx>::type::K)...};
+        }
+
+        template<size_t... idx>
+        int find_map(const std::string &path, std::index_sequence<idx...>) {
+            int res = -1;
+            ((res == -1 and get_map_impl<idx>::type::matches(path) and (res = int(idx), true)), ...);
+            return res;
+        }
+    }
+
+    /// `EmbeddedMap` с номером `idx` или void для -1
+    template<int idx>
+    using get_map = details::get_map_impl<idx>::type;
+
+    /// Номер встроенной карты с тем же расположением стен, что и в файле `path`, или -1
+    inline int find_embedded_map(const std::string &path) {
+        return details::find_map(path, std::make_index_sequence<std::tuple_size_v<embedded_maps>>{});
+    }
+
+    /// В compile-time заполняет массив из ВСЕХ ВОЗМОЖНЫХ комбинации 3-х типов данных и размеров поля(включая
+    /// "динамический" и встроенные карты)
+    /// \return Массив из шестёрок int: первые 3 - типы данных, затем 2 размера поля и номер встроенной карты (-1 - нет)
     constexpr auto get_fields() {
         constexpr std::pair<int, int> temp[] = {{-1, -1}, SIZES};
         constexpr int sz = sizeof(temp) / sizeof(std::pair<int, int>);
 
         constexpr auto types = std::array{TYPES};
         constexpr std::array<std::pair<int, int>, sz> sizes = {std::pair<int, int>(-1, -1), SIZES};
+        constexpr auto maps = details::map_sizes(std::make_index_sequence<std::tuple_size_v<embedded_maps>>{});
 
-        std::array<std::tuple<int, int, int, int, int>, types.size() * types.size() * types.size() * sz> res{};
+        std::array<std::tuple<int, int, int, int, int, int>,
+                types.size() * types.size() * types.size() * (sz + maps.size())> res{};
 
         int i = 0;
         for (int type_p: types) {
             for (int type_v: types) {
                 for (int type_vf: types) {
                     for (auto field_size: sizes) {
-                        res[i++] = {type_p, type_v, type_vf, field_size.first, field_size.second};
+                        res[i++] = {type_p, type_v, type_vf, field_size.first, field_size.second, -1};
+                    }
+                    for (int map = 0; map < int(maps.size()); ++map) {
+                        res[i++] = {type_p, type_v, type_vf, maps[map].first, maps[map].second, map};
                     }
                 }
             }
@@ -111,13 +171,17 @@ namespace Emulator {
             fields_generator[idx - 1] = generate;
         }
 
+        using field_type = FieldEmulator<
+                get_type<get<0>(fields[idx - 1])>,
+                get_type<get<1>(fields[idx - 1])>,
+                get_type<get<2>(fields[idx - 1])>,
+                get<3>(fields[idx - 1]),
+                get<4>(fields[idx - 1]),
+                FIELD_LAYOUT,
+                get_map<get<5>(fields[idx - 1])>>;
+
         static std::shared_ptr<AbstractField> generate() {
-            return std::make_shared<FieldEmulator<
-                    get_type<get<0>(fields[idx - 1])>,
-                    get_type<get<1>(fields[idx - 1])>,
-                    get_type<get<2>(fields[idx - 1])>,
-                    get<3>(fields[idx - 1]),
-                    get<4>(fields[idx - 1]) >>();
+            return std::allocate_shared<field_type>(PageAllocator<field_type>());
         }
     };
 
@@ -130,17 +194,33 @@ namespace Emulator {
     [[maybe_unused]] FieldGeneratorIndex<fields.size()> generator{};
 }
 
-std::shared_ptr<Emulator::AbstractField> get_field(int type_p, int type_v, int type_vf, int N, int K) {
+/// \param map Номер встроенной карты из `Emulator::find_embedded_map`, -1 - без неё
+std::shared_ptr<Emulator::AbstractField> get_field(int type_p, int type_v, int type_vf, int N, int K, int map = -1) {
     using Emulator::fields;
     using Emulator::fields_generator;
 
-    auto ind = std::find(fields.begin(), fields.end(), std::tuple(type_p, type_v, type_vf, N, K)) - fields.begin();
+    auto ind = std::find(fields.begin(), fields.end(), std::tuple(type_p, type_v, type_vf, N, K, map)) - fields.begin();
+    if (ind == fields.size()) {
+        ind = std::find(fields.begin(), fields.end(), std::tuple(type_p, type_v, type_vf, N, K, -1)) - fields.begin();
+    }
+    if (ind == fields.size()) {
+        // Наименьшая статическая ёмкость, в которую помещается поле, - лишние строки и столбцы станут стенами
+        int64_t best_area = -1;
+        for (size_t i = 0; i < fields.size(); ++i) {
+            auto [p, v, vf, n, k, m] = fields[i];
+            if (std::tuple(p, v, vf, m) == std::tuple(type_p, type_v, type_vf, -1) and n >= N and k >= K and
+                (best_area == -1 or int64_t(n) * k < best_area)) {
+                best_area = int64_t(n) * k;
+                ind = i;
+            }
+        }
+    }
 
     std::shared_ptr<Emulator::AbstractField> field;
     if (ind != fields.size()) {
         field = fields_generator[ind]();
     } else {
-        ind = std::find(fields.begin(), fields.end(), std::tuple(type_p, type_v, type_vf, -1, -1)) - fields.begin();
+        ind = std::find(fields.begin(), fields.end(), std::tuple(type_p, type_v, type_vf, -1, -1, -1)) - fields.begin();
         if (ind == fields.size()) {
             std::cout << "Error: Unknown data types" << std::endl;
             exit(-1);
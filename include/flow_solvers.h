@@ -0,0 +1,596 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cstdint>
+
+#include "page_memory.h"
+#include "utilities.h"
+
+namespace Emulator {
+    /// Алгоритм заполнения `velocity_flow` в `apply_forces_on_flow`
+    enum class FlowSolverKind {
+        dfs,
+        dinic,
+        push_relabel,
+    };
+
+    inline FlowSolverKind get_flow_solver(const std::string &name) {
+        if (name == "dfs") {
+            return FlowSolverKind::dfs;
+        }
+        if (name == "dinic") {
+            return FlowSolverKind::dinic;
+        }
+        if (name == "push-relabel") {
+            return FlowSolverKind::push_relabel;
+        }
+        std::cout << "Error: flow solver `" << name << "` not found" << std::endl;
+        exit(-1);
+    }
+
+    /// Начинать ли заполнение `velocity_flow` с потока прошлого тика
+    inline bool get_flow_warm_start(const std::string &name) {
+        if (name == "cold") {
+            return false;
+        }
+        if (name == "warm") {
+            return true;
+        }
+        std::cout << "Error: flow start `" << name << "` not found" << std::endl;
+        exit(-1);
+    }
+
+    class FlowEngine {
+    public:
+        virtual void solve() = 0;
+
+        virtual ~FlowEngine() = default;
+    };
+
+    /// Общая часть движков, работающих с явным массивом остаточных пропускных способностей.
+    /// Поток ищется как циркуляция: для каждой клетки s по очереди считается максимальный поток из s в саму себя.
+    /// Дуги остаточной сети: прямая u -> v с ёмкостью `residual[u][d]` и обратная, отменяющая поток по ребру v -> u.
+    /// Циклы целиком лежат в одной компоненте сильной связности, поэтому поиск из s ограничен её компонентой, а клетки
+    /// вне циклов не рассматриваются вовсе. Обработанная клетка исключается из дальнейших поисков, так что один проход
+    /// по полю заменяет перезапуски с `--y` у `propagate_flow`
+    template<typename T>
+    class ResidualFlowEngine : public FlowEngine {
+    protected:
+        using vf_type = typename T::vf_type;
+        static constexpr int directions = deltas.size();
+        /// 0...3 - прямые дуги по `deltas`, 4...7 - обратные
+        static constexpr int arcs = 2 * directions;
+        /// Дуги и избытки меньше этой величины считаются нулевыми. Для чисел с фиксированной точкой это просто ноль,
+        /// для плавающей точки - защита от бесконечного проталкивания ошибок округления
+        static inline const vf_type epsilon = 1e-9;
+
+        T *f;
+        int K = 0;
+        int size = 0;
+
+        PageVector<uint8_t> open;
+        PageVector<std::array<vf_type, directions>> residual;
+        PageVector<std::array<vf_type, directions>> flow;
+        /// Номер компоненты сильной связности, -1 если клетка не лежит ни на одном цикле или уже обработана
+        PageVector<int> comp;
+        PageVector<int> comp_size;
+
+        /// Отметки посещения текущего поиска, чтобы не очищать массивы перед каждой клеткой
+        PageVector<int> seen;
+        int epoch = 0;
+
+        PageVector<int> queue;
+
+    private:
+        PageVector<int> index, low;
+        PageVector<uint8_t> on_stack;
+        PageVector<int> scc_stack;
+        PageVector<std::pair<int, int>> call_stack;
+
+    public:
+        explicit ResidualFlowEngine(T &field) : f(&field), K(field.K), size(field.N * field.K) {
+            open.assign(size, 0);
+            residual.assign(size, {});
+            flow.assign(size, {});
+            comp.assign(size, -1);
+            seen.assign(size, 0);
+            index.assign(size, -1);
+            low.assign(size, 0);
+            on_stack.assign(size, false);
+            queue.reserve(size);
+            scc_stack.reserve(size);
+            call_stack.reserve(size);
+
+            for (int x = 0; x < f->N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    open[x * K + y] = f->meta[x][y].is_wall() ? 0 : f->meta[x][y].info & 0xF;
+                }
+            }
+        }
+
+        void solve() override {
+            build_residual();
+            build_components();
+            for (int s = 0; s < size; ++s) {
+                if (comp[s] < 0) {
+                    continue;
+                }
+                solve_from(s);
+                comp[s] = -1;
+            }
+            write_back();
+        }
+
+    protected:
+        virtual void solve_from(int s) = 0;
+
+        [[nodiscard]] int neighbour(int u, int d) const {
+            return u + deltas[d].first * K + deltas[d].second;
+        }
+
+        static constexpr int opposite(int d) {
+            return d ^ 1;
+        }
+
+        /// Остаточная ёмкость дуги `a` из клетки `u` в соседнюю `v`
+        vf_type &available(int u, int v, int a) {
+            return a < directions ? residual[u][a] : flow[v][opposite(a - directions)];
+        }
+
+        void push(int u, int v, int a, const vf_type &value) {
+            if (a < directions) {
+                residual[u][a] -= value;
+                flow[u][a] += value;
+            } else {
+                int d = opposite(a - directions);
+                flow[v][d] -= value;
+                residual[v][d] += value;
+            }
+        }
+
+    private:
+        void build_residual() {
+            for (int x = 0; x < f->N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    int u = x * K + y;
+                    for (int d = 0; d < directions; ++d) {
+                        residual[u][d] = flow[u][d] = vf_type{};
+                        if (not(open[u] >> d & 1)) {
+                            continue;
+                        }
+                        vf_type cap = vf_type(f->velocity.get(x, y, d));
+                        flow[u][d] = f->velocity_flow.get(x, y, d);
+                        if (cap - flow[u][d] > 0.0001) {
+                            residual[u][d] = cap - flow[u][d];
+                        }
+                    }
+                }
+            }
+        }
+
+        /// Итеративный алгоритм Тарьяна по дугам с положительной остаточной ёмкостью
+        void build_components() {
+            std::fill(index.begin(), index.end(), -1);
+            comp_size.clear();
+            int counter = 0;
+            for (int root = 0; root < size; ++root) {
+                comp[root] = -1;
+            }
+            for (int root = 0; root < size; ++root) {
+                if (open[root] == 0 or index[root] != -1) {
+                    continue;
+                }
+                call_stack.emplace_back(root, 0);
+                index[root] = low[root] = counter++;
+                scc_stack.push_back(root);
+                on_stack[root] = true;
+                while (not call_stack.empty()) {
+                    auto &[u, a] = call_stack.back();
+                    if (a < arcs) {
+                        int d = a % directions;
+                        ++a;
+                        if (not(open[u] >> d & 1)) {
+                            continue;
+                        }
+                        int v = neighbour(u, d);
+                        if (not(available(u, v, a - 1) > epsilon)) {
+                            continue;
+                        }
+                        if (index[v] == -1) {
+                            index[v] = low[v] = counter++;
+                            scc_stack.push_back(v);
+                            on_stack[v] = true;
+                            call_stack.emplace_back(v, 0);
+                        } else if (on_stack[v]) {
+                            low[u] = std::min(low[u], index[v]);
+                        }
+                        continue;
+                    }
+                    int done = u;
+                    call_stack.pop_back();
+                    if (not call_stack.empty()) {
+                        int parent = call_stack.back().first;
+                        low[parent] = std::min(low[parent], low[done]);
+                    }
+                    if (low[done] != index[done]) {
+                        continue;
+                    }
+                    int id = int(comp_size.size()), cnt = 0, w;
+                    do {
+                        w = scc_stack.back();
+                        scc_stack.pop_back();
+                        on_stack[w] = false;
+                        comp[w] = id;
+                        ++cnt;
+                    } while (w != done);
+                    comp_size.push_back(cnt);
+                    if (cnt == 1) {
+                        comp[done] = -1;
+                    }
+                }
+            }
+        }
+
+        void write_back() {
+            for (int x = 0; x < f->N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    int u = x * K + y;
+                    for (int d = 0; d < directions; ++d) {
+                        if (not(open[u] >> d & 1)) {
+                            continue;
+                        }
+                        // Ёмкость может быть отрицательной после сил давления, поток по такому ребру, как и в `dfs`, нулевой
+                        vf_type cap = vf_type(f->velocity.get(x, y, d));
+                        f->velocity_flow.get(x, y, d) = std::max(vf_type{}, std::min(flow[u][d], cap));
+                    }
+                }
+            }
+        }
+    };
+
+    /// Алгоритм Диница: BFS строит слоистую сеть от s, затем блокирующий поток ищется обходом с текущими дугами.
+    /// Стоком служит та же клетка s, в неё ведут только прямые дуги
+    template<typename T>
+    class DinicFlowEngine : public ResidualFlowEngine<T> {
+        using base = ResidualFlowEngine<T>;
+        using typename base::vf_type;
+        using base::directions;
+        using base::arcs;
+
+        PageVector<int> level;
+        PageVector<int> current;
+        PageVector<std::pair<int, int>> path;
+
+    public:
+        explicit DinicFlowEngine(T &field) : base(field) {
+            level.assign(this->size, 0);
+            current.assign(this->size, 0);
+            path.reserve(this->size);
+        }
+
+    protected:
+        void solve_from(int s) override {
+            while (build_levels(s)) {
+                while (augment(s)) {}
+            }
+        }
+
+    private:
+        bool admissible(int s, int u, int v, int a) {
+            if (not(this->open[u] >> (a % directions) & 1) or this->comp[v] != this->comp[s]) {
+                return false;
+            }
+            if (u == s and a >= directions) {
+                return false;
+            }
+            return this->available(u, v, a) > base::epsilon;
+        }
+
+        bool build_levels(int s) {
+            int stamp = ++this->epoch;
+            auto &queue = this->queue;
+            queue.clear();
+            queue.push_back(s);
+            this->seen[s] = stamp;
+            level[s] = 0;
+            current[s] = 0;
+            bool found = false;
+            for (size_t head = 0; head < queue.size(); ++head) {
+                int u = queue[head];
+                for (int a = 0; a < arcs; ++a) {
+                    int v = this->neighbour(u, a % directions);
+                    if (not admissible(s, u, v, a)) {
+                        continue;
+                    }
+                    if (v == s) {
+                        found |= a < directions;
+                        continue;
+                    }
+                    if (this->seen[v] != stamp) {
+                        this->seen[v] = stamp;
+                        level[v] = level[u] + 1;
+                        current[v] = 0;
+                        queue.push_back(v);
+                    }
+                }
+            }
+            return found;
+        }
+
+        bool augment(int s) {
+            int stamp = this->epoch;
+            path.clear();
+            int u = s;
+            while (true) {
+                bool advanced = false;
+                for (; current[u] < arcs; ++current[u]) {
+                    int a = current[u];
+                    int v = this->neighbour(u, a % directions);
+                    if (not admissible(s, u, v, a)) {
+                        continue;
+                    }
+                    if (v == s) {
+                        if (a >= directions) {
+                            continue;
+                        }
+                        path.emplace_back(u, a);
+                        push_path();
+                        return true;
+                    }
+                    if (this->seen[v] == stamp and level[v] == level[u] + 1) {
+                        path.emplace_back(u, a);
+                        u = v;
+                        advanced = true;
+                        break;
+                    }
+                }
+                if (advanced) {
+                    continue;
+                }
+                if (u == s) {
+                    return false;
+                }
+                level[u] = -1;
+                u = path.back().first;
+                path.pop_back();
+                ++current[u];
+            }
+        }
+
+        void push_path() {
+            vf_type value{};
+            bool first = true;
+            for (auto [u, a]: path) {
+                int v = this->neighbour(u, a % directions);
+                const auto &cap = this->available(u, v, a);
+                if (first or cap < value) {
+                    value = cap;
+                    first = false;
+                }
+            }
+            for (auto [u, a]: path) {
+                this->push(u, this->neighbour(u, a % directions), a, value);
+            }
+        }
+    };
+
+    /// Проталкивание предпотока (FIFO) из s в s. Исток - все прямые дуги из s, сток - прямые дуги в s,
+    /// избыток возвращается в исток по обратным дугам в s
+    template<typename T>
+    class PushRelabelFlowEngine : public ResidualFlowEngine<T> {
+        using base = ResidualFlowEngine<T>;
+        using typename base::vf_type;
+        using base::directions;
+        using base::arcs;
+
+        PageVector<int> height;
+        PageVector<int> current;
+        PageVector<vf_type> excess;
+
+    public:
+        explicit PushRelabelFlowEngine(T &field) : base(field) {
+            height.assign(this->size, 0);
+            current.assign(this->size, 0);
+            excess.assign(this->size, vf_type{});
+        }
+
+    protected:
+        void solve_from(int s) override {
+            int stamp = ++this->epoch;
+            auto &queue = this->queue;
+            queue.clear();
+            int source_height = this->comp_size[this->comp[s]];
+
+            for (int d = 0; d < directions; ++d) {
+                int v = this->neighbour(s, d);
+                if (not usable(s, v, d) or v == s) {
+                    continue;
+                }
+                vf_type value = this->residual[s][d];
+                this->push(s, v, d, value);
+                activate(v, stamp);
+                excess[v] += value;
+            }
+
+            for (size_t head = 0; head < queue.size(); ++head) {
+                discharge(s, queue[head], source_height, stamp);
+            }
+        }
+
+    private:
+        bool usable(int u, int v, int a) {
+            return (this->open[u] >> (a % directions) & 1) and this->comp[v] == this->comp[u] and
+                   this->available(u, v, a) > base::epsilon;
+        }
+
+        void activate(int v, int stamp) {
+            if (this->seen[v] != stamp) {
+                this->seen[v] = stamp;
+                height[v] = 0;
+                current[v] = 0;
+                excess[v] = vf_type{};
+            }
+            if (not(excess[v] > base::epsilon)) {
+                this->queue.push_back(v);
+            }
+        }
+
+        int target_height(int s, int v, int a, int source_height) {
+            if (v == s) {
+                return a < directions ? 0 : source_height;
+            }
+            return this->seen[v] == this->epoch ? height[v] : 0;
+        }
+
+        void discharge(int s, int u, int source_height, int stamp) {
+            while (excess[u] > base::epsilon) {
+                if (current[u] == arcs) {
+                    int lowest = -1;
+                    for (int a = 0; a < arcs; ++a) {
+                        int v = this->neighbour(u, a % directions);
+                        if (usable(u, v, a)) {
+                            int h = target_height(s, v, a, source_height);
+                            lowest = lowest == -1 ? h : std::min(lowest, h);
+                        }
+                    }
+                    if (lowest == -1) {
+                        return;
+                    }
+                    height[u] = lowest + 1;
+                    current[u] = 0;
+                    continue;
+                }
+                int a = current[u];
+                int v = this->neighbour(u, a % directions);
+                if (not usable(u, v, a) or height[u] != target_height(s, v, a, source_height) + 1) {
+                    ++current[u];
+                    continue;
+                }
+                vf_type value = std::min(excess[u], this->available(u, v, a));
+                this->push(u, v, a, value);
+                excess[u] -= value;
+                if (v != s) {
+                    activate(v, stamp);
+                    excess[v] += value;
+                }
+            }
+        }
+    };
+
+    /// Подготовка потока прошлого тика к новым ёмкостям. Поток по ребру, превысивший новую ёмкость, уменьшается вместе
+    /// с циклами, в которые он входил: ищется путь по рёбрам с положительным потоком из конца ребра в его начало,
+    /// и разница снимается с пути и ребра. Поиски путей идут только от рёбер, ставших недопустимыми, но сама проверка
+    /// просматривает все рёбра поля
+    template<typename T>
+    class FlowWarmStart {
+        using vf_type = typename T::vf_type;
+        static constexpr int directions = deltas.size();
+        static inline const vf_type epsilon = 1e-9;
+
+        T *f;
+        int K = 0;
+        PageVector<int> seen;
+        PageVector<int8_t> parent;
+        PageVector<std::pair<int, int>> queue;
+        int epoch = 0;
+
+    public:
+        explicit FlowWarmStart(T &field) : f(&field), K(field.K) {
+            seen.assign(field.N * field.K, 0);
+            parent.assign(field.N * field.K, -1);
+            queue.reserve(field.N * field.K);
+        }
+
+        /// \return false, если поток не удалось согласовать (например, из-за ошибок округления) и его нужно обнулить
+        bool repair() {
+            for (int x = 0; x < f->N; ++x) {
+                for (int y = 0; y < K; ++y) {
+                    auto &flows = f->velocity_flow.v[x][y];
+                    for (int d = 0; d < directions; ++d) {
+                        if (flows[d] > vf_type{} and not clip(x, y, d)) {
+                            return false;
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+
+    private:
+        bool clip(int x, int y, int d) {
+            auto &flow = f->velocity_flow.v[x][y][d];
+            vf_type cap = std::max(vf_type(f->velocity.v[x][y][d]), vf_type{});
+            vf_type excess = flow - cap;
+            while (excess > epsilon) {
+                if (not find_path(x + deltas[d].first, y + deltas[d].second, x, y)) {
+                    return false;
+                }
+                vf_type value = std::min(excess, bottleneck(x, y));
+                cancel_path(x, y, value);
+                flow -= value;
+                excess -= value;
+            }
+            if (flow > cap) {
+                flow = cap;
+            }
+            return true;
+        }
+
+        /// BFS по рёбрам с положительным потоком из (sx, sy) в (tx, ty)
+        bool find_path(int sx, int sy, int tx, int ty) {
+            int stamp = ++epoch;
+            queue.clear();
+            queue.emplace_back(sx, sy);
+            seen[sx * K + sy] = stamp;
+            for (size_t head = 0; head < queue.size(); ++head) {
+                auto [x, y] = queue[head];
+                if (x == tx and y == ty) {
+                    return true;
+                }
+                const auto &cell = f->meta[x][y];
+                for (int d = 0; d < directions; ++d) {
+                    auto [dx, dy] = deltas[d];
+                    int nx = x + dx, ny = y + dy;
+                    if (not cell.open(d) or seen[nx * K + ny] == stamp or
+                        not(f->velocity_flow.get(x, y, d) > epsilon)) {
+                        continue;
+                    }
+                    seen[nx * K + ny] = stamp;
+                    parent[nx * K + ny] = int8_t(d);
+                    queue.emplace_back(nx, ny);
+                }
+            }
+            return false;
+        }
+
+        /// Минимальный поток на найденном пути, заканчивающемся в (x, y)
+        vf_type bottleneck(int x, int y) {
+            vf_type value{};
+            bool first = true;
+            while (x * K + y != queue.front().first * K + queue.front().second) {
+                int d = parent[x * K + y];
+                x -= deltas[d].first;
+                y -= deltas[d].second;
+                const auto &flow = f->velocity_flow.get(x, y, d);
+                if (first or flow < value) {
+                    value = flow;
+                    first = false;
+                }
+            }
+            return value;
+        }
+
+        void cancel_path(int x, int y, const vf_type &value) {
+            while (x * K + y != queue.front().first * K + queue.front().second) {
+                int d = parent[x * K + y];
+                x -= deltas[d].first;
+                y -= deltas[d].second;
+                f->velocity_flow.get(x, y, d) -= value;
+            }
+        }
+    };
+}
@@ -46,6 +46,8 @@ namespace Emulator {
 
         constexpr Fixed(const Fixed &other) : v(other.v) {}
 
+        constexpr Fixed &operator=(const Fixed &other) = default;
+
         constexpr Fixed(int64_t v) : v(v << K) {}
 
         constexpr Fixed(float f) : v(f * (1LL << K)) {}
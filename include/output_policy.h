@@ -0,0 +1,84 @@
+#pragma once
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+namespace Emulator {
+    /// Когда выводить поле на экран. Формат опции `--output`:
+    /// `changes` - после каждого тика, в котором что-то сдвинулось (по умолчанию), `none` - никогда,
+    /// `every:N` - каждый N-й тик, `interval:ms` - не чаще раза в ms миллисекунд, `final` - один раз в конце
+    class OutputPolicy {
+    public:
+        enum class Mode {
+            changes,
+            none,
+            every,
+            interval,
+            final,
+        };
+
+    private:
+        Mode mode_ = Mode::changes;
+        int every_ = 1;
+        std::chrono::milliseconds interval_{0};
+        std::chrono::steady_clock::time_point last_{};
+
+    public:
+        OutputPolicy() = default;
+
+        explicit OutputPolicy(const std::string &option) {
+            size_t pos = option.find(':');
+            std::string name = option.substr(0, pos);
+            int value = 0;
+            if (pos != std::string::npos) {
+                try {
+                    value = std::stoi(option.substr(pos + 1));
+                } catch (const std::exception &) {
+                    value = -1;
+                }
+            }
+            if (name == "changes" and pos == std::string::npos) {
+                mode_ = Mode::changes;
+            } else if (name == "none" and pos == std::string::npos) {
+                mode_ = Mode::none;
+            } else if (name == "final" and pos == std::string::npos) {
+                mode_ = Mode::final;
+            } else if (name == "every" and value > 0) {
+                mode_ = Mode::every;
+                every_ = value;
+            } else if (name == "interval" and value >= 0 and pos != std::string::npos) {
+                mode_ = Mode::interval;
+                interval_ = std::chrono::milliseconds(value);
+            } else {
+                std::cout << "Error: unknown output mode `" << option << "`" << std::endl;
+                exit(-1);
+            }
+        }
+
+        [[nodiscard]] Mode mode() const {
+            return mode_;
+        }
+
+        /// Нужно ли выводить поле после тика `tick`
+        /// \param moved Сдвинулась ли в этом тике хоть одна клетка
+        bool should_output(int tick, bool moved) {
+            switch (mode_) {
+                case Mode::changes:
+                    return moved;
+                case Mode::every:
+                    return (tick + 1) % every_ == 0;
+                case Mode::interval: {
+                    auto now = std::chrono::steady_clock::now();
+                    if (now - last_ < interval_) {
+                        return false;
+                    }
+                    last_ = now;
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+    };
+}
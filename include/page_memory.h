@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <linux/mman.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace Emulator {
+    enum class HugePages {
+        off,
+        /// Обычное отображение с `madvise(MADV_HUGEPAGE)`, страницы 2MB выдаёт ядро, если может
+        transparent,
+        /// `MAP_HUGETLB`, нужны заранее выделенные страницы (`vm.nr_hugepages`), без них - как `transparent`
+        hugetlb,
+    };
+
+    inline HugePages get_huge_pages(const std::string &name) {
+        if (name == "off") {
+            return HugePages::off;
+        }
+        if (name == "thp") {
+            return HugePages::transparent;
+        }
+        if (name == "hugetlb") {
+            return HugePages::hugetlb;
+        }
+        std::cout << "Error: huge pages mode `" << name << "` not found" << std::endl;
+        exit(-1);
+    }
+
+    /// Как выделять память под массивы состояния поля. Задаётся до создания поля
+    struct MemoryPolicy {
+        static constexpr size_t alignment = 64;
+        static constexpr size_t huge_page = size_t(2) << 20;
+
+        static inline HugePages pages = HugePages::off;
+
+        /// Каталог для файлов, в которые отображаются крупные массивы, пусто - в оперативной памяти. Страницы таких
+        /// массивов вытесняет на диск и подчитывает обратно ядро (LRU страничного кэша), так что состояние поля может
+        /// превышать объём памяти
+        static inline std::string backing_dir;
+    };
+
+    /// Выделенный блок и то, как его освобождать
+    struct Allocation {
+        void *ptr = nullptr;
+        size_t bytes = 0;
+        bool mapped = false;
+    };
+
+    /// Выравнивание на кэш-линию, обычные страницы
+    struct AlignedAllocation {
+        static Allocation allocate(size_t bytes) {
+            return {::operator new(bytes, std::align_val_t(MemoryPolicy::alignment)), bytes, false};
+        }
+
+        static void deallocate(const Allocation &block) {
+            ::operator delete(block.ptr, std::align_val_t(MemoryPolicy::alignment));
+        }
+    };
+
+    /// Блоки от половины huge page при включённых `MemoryPolicy::pages` отображаются `mmap` на границе 2MB, меньшие -
+    /// как `AlignedAllocation`. Случайные обходы `propagate_*` по большим картам так задевают меньше записей TLB.
+    /// При заданном `MemoryPolicy::backing_dir` такие блоки вместо этого отображаются из файлов в нём
+    struct PageAllocation {
+        static bool maps(size_t bytes, HugePages pages, bool file) {
+            return (pages != HugePages::off or file) and bytes >= MemoryPolicy::huge_page / 2;
+        }
+
+        static size_t mapped_size(size_t bytes) {
+            return (bytes + MemoryPolicy::huge_page - 1) / MemoryPolicy::huge_page * MemoryPolicy::huge_page;
+        }
+
+        static Allocation allocate(size_t bytes, HugePages pages = MemoryPolicy::pages,
+                                   bool file = not MemoryPolicy::backing_dir.empty()) {
+            if (not maps(bytes, pages, file)) {
+                return AlignedAllocation::allocate(bytes);
+            }
+            size_t size = mapped_size(bytes);
+            if (file) {
+                return {map_file(size), size, true};
+            }
+            if (pages == HugePages::hugetlb) {
+                void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+                if (ptr != MAP_FAILED) {
+                    return {ptr, size, true};
+                }
+                static bool warned = false;
+                if (not std::exchange(warned, true)) {
+                    std::cout << "Warning: no free 2MB pages for MAP_HUGETLB (vm.nr_hugepages), "
+                                 "using transparent huge pages" << std::endl;
+                }
+            }
+            // Берём на huge page больше и обрезаем края, чтобы начало блока легло на границу 2MB
+            size_t extended = size + MemoryPolicy::huge_page;
+            void *raw = mmap(nullptr, extended, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            auto begin = reinterpret_cast<uintptr_t>(raw);
+            auto aligned = (begin + MemoryPolicy::huge_page - 1) / MemoryPolicy::huge_page * MemoryPolicy::huge_page;
+            if (aligned > begin) {
+                munmap(raw, aligned - begin);
+            }
+            if (begin + extended > aligned + size) {
+                munmap(reinterpret_cast<void *>(aligned + size), begin + extended - aligned - size);
+            }
+            auto *ptr = reinterpret_cast<void *>(aligned);
+            madvise(ptr, size, MADV_HUGEPAGE);
+            return {ptr, size, true};
+        }
+
+        static void deallocate(const Allocation &block) {
+            if (block.mapped) {
+                munmap(block.ptr, block.bytes);
+            } else {
+                AlignedAllocation::deallocate(block);
+            }
+        }
+
+    private:
+        /// Файл создаётся и сразу удаляется, место на диске освобождается вместе с отображением
+        static void *map_file(size_t size) {
+            std::string path = MemoryPolicy::backing_dir + "/se2_cpp_hw2_XXXXXX";
+            int fd = mkstemp(path.data());
+            if (fd == -1) {
+                std::cout << "Error: can`t create backing file in `" << MemoryPolicy::backing_dir << "`" << std::endl;
+                exit(-1);
+            }
+            unlink(path.c_str());
+            if (ftruncate(fd, off_t(size)) == -1) {
+                close(fd);
+                std::cout << "Error: can`t resize backing file in `" << MemoryPolicy::backing_dir << "`" << std::endl;
+                exit(-1);
+            }
+            void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (ptr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            return ptr;
+        }
+    };
+
+    /// `madvise` для страниц, которые задевает [begin, end)
+    inline void advise(const void *begin, const void *end, int advice) {
+        static const auto page = uintptr_t(sysconf(_SC_PAGESIZE));
+        auto first = reinterpret_cast<uintptr_t>(begin) / page * page;
+        auto last = reinterpret_cast<uintptr_t>(end);
+        if (last > first) {
+            madvise(reinterpret_cast<void *>(first), last - first, advice);
+        }
+    }
+
+    /// Аллокатор для `std::allocate_shared` и `PageVector`, размещающий объект поля (вместе со статическими массивами) через
+    /// `PageAllocation`. Режим памяти запоминается при создании, чтобы освобождение совпало с выделением
+    template<typename T>
+    struct PageAllocator {
+        using value_type = T;
+
+        HugePages pages = MemoryPolicy::pages;
+        bool file = not MemoryPolicy::backing_dir.empty();
+
+        PageAllocator() = default;
+
+        template<typename U>
+        PageAllocator(const PageAllocator<U> &other) : pages(other.pages), file(other.file) {}
+
+        T *allocate(size_t n) {
+            static_assert(alignof(T) <= MemoryPolicy::alignment);
+            return static_cast<T *>(PageAllocation::allocate(n * sizeof(T), pages, file).ptr);
+        }
+
+        void deallocate(T *ptr, size_t n) {
+            size_t bytes = n * sizeof(T);
+            bool mapped = PageAllocation::maps(bytes, pages, file);
+            PageAllocation::deallocate({ptr, mapped ? PageAllocation::mapped_size(bytes) : bytes, mapped});
+        }
+
+        template<typename U>
+        bool operator==(const PageAllocator<U> &other) const {
+            return pages == other.pages and file == other.file;
+        }
+    };
+
+    /// Вектор на `PageAllocator` для вспомогательных массивов по клеткам (стеки обходов, массивы алгоритмов потока,
+    /// буфер случайных чисел, кадры экспорта): с `MemoryPolicy::backing_dir` они тоже отображаются из файлов
+    template<typename T>
+    using PageVector = std::vector<T, PageAllocator<T>>;
+
+    /// Непрерывный буфер из `size` элементов, выделенный политикой `Storage` и заполненный `Type{}`
+    template<typename Type, typename Storage>
+    class Buffer {
+        Allocation block{};
+        size_t count = 0;
+
+    public:
+        Buffer() = default;
+
+        Buffer(const Buffer &) = delete;
+
+        ~Buffer() {
+            reset();
+        }
+
+        /// Заменяет содержимое на `n` элементов `Type{}`
+        void assign(size_t n) {
+            reset();
+            if (n == 0) {
+                return;
+            }
+            block = Storage::allocate(n * sizeof(Type));
+            std::uninitialized_value_construct_n(static_cast<Type *>(block.ptr), n);
+            count = n;
+        }
+
+        void fill(const Type &value) {
+            std::fill(begin(), end(), value);
+        }
+
+        Buffer &operator=(const Buffer &other) {
+            if (this == &other) {
+                return *this;
+            }
+            if (count != other.count) {
+                assign(other.count);
+            }
+            std::copy(other.begin(), other.end(), begin());
+            return *this;
+        }
+
+        [[nodiscard]] Type *data() const {
+            return static_cast<Type *>(block.ptr);
+        }
+
+        [[nodiscard]] size_t size() const {
+            return count;
+        }
+
+        [[nodiscard]] Type *begin() const {
+            return data();
+        }
+
+        [[nodiscard]] Type *end() const {
+            return data() + count;
+        }
+
+    private:
+        void reset() {
+            if (block.ptr == nullptr) {
+                return;
+            }
+            std::destroy_n(data(), count);
+            Storage::deallocate(block);
+            block = {};
+            count = 0;
+        }
+    };
+}
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/// Счётчики `perf_event_open` по фазам тика и типам задач. Каждый поток открывает свою группу счётчиков при первом
+/// замере и копит результаты у себя; сводка печатается каждые `every` тиков, когда остальные потоки простаивают.
+/// Если аппаратные счётчики недоступны (например, в контейнере), используются программные, а без них - только время.
+/// Когда событий больше, чем аппаратных счётчиков (или их делит `perf stat`), ядро включает группу по очереди; значения
+/// тогда масштабируются на долю времени, когда группа считала, а эта доля выводится в столбце `counted,%`
+class PerfCounters {
+public:
+    static constexpr int events = 4;
+
+    enum class Kind {
+        none,
+        hardware,
+        software,
+    };
+
+    struct Reading {
+        std::chrono::steady_clock::time_point time;
+        std::array<uint64_t, events> values{};
+        /// Время, когда группа была включена и когда действительно считала, нс
+        uint64_t enabled = 0;
+        uint64_t running = 0;
+    };
+
+private:
+    struct Sample {
+        const char *name;
+        uint64_t calls = 0;
+        std::chrono::nanoseconds time{0};
+        std::array<uint64_t, events> values{};
+        uint64_t enabled = 0;
+        uint64_t running = 0;
+    };
+
+    struct ThreadCounters {
+        int leader = -1;
+        std::vector<int> fds;
+        std::vector<Sample> samples;
+
+        ~ThreadCounters() {
+            for (int fd: fds) {
+                close(fd);
+            }
+        }
+    };
+
+    static constexpr std::array<std::pair<uint32_t, uint64_t>, events> hardware_events{{
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    }};
+    static constexpr std::array<std::pair<uint32_t, uint64_t>, events> software_events{{
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+            {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+    }};
+
+    static inline std::atomic<bool> enabled_ = false;
+    static inline Kind kind_ = Kind::none;
+    static inline int error_ = 0;
+    static inline int every_ = 0;
+    static inline int range_start_ = 0;
+    static inline std::mutex mutex_;
+    static inline std::vector<std::unique_ptr<ThreadCounters>> threads_;
+    static inline thread_local ThreadCounters *local_ = nullptr;
+
+public:
+    [[nodiscard]] static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /// Включает замеры и выбирает доступный набор счётчиков
+    /// \param every Через сколько тиков печатать сводку, 0 - только в конце
+    static void start(int every) {
+        every_ = every;
+        for (Kind kind: {Kind::hardware, Kind::software}) {
+            kind_ = kind;
+            ThreadCounters probe;
+            if (open(probe)) {
+                break;
+            }
+            kind_ = Kind::none;
+        }
+        if (kind_ == Kind::none) {
+            std::cout << "perf_event_open is unavailable (" << std::strerror(error_) << "), only wall time is measured"
+                      << std::endl;
+        }
+        enabled_ = true;
+    }
+
+    static Reading read() {
+        Reading reading;
+        auto &local = counters();
+        if (local.leader != -1) {
+            // nr, time_enabled, time_running, значения
+            std::array<uint64_t, events + 3> buffer{};
+            if (::read(local.leader, buffer.data(), sizeof(buffer)) > 0) {
+                reading.enabled = buffer[1];
+                reading.running = buffer[2];
+                std::copy(buffer.begin() + 3, buffer.begin() + 3 + buffer[0], reading.values.begin());
+            }
+        }
+        reading.time = std::chrono::steady_clock::now();
+        return reading;
+    }
+
+    /// Добавляет к замерам `name` разницу между текущими показаниями и `begin`
+    static void add(const char *name, const Reading &begin) {
+        Reading now = read();
+        auto &samples = counters().samples;
+        auto it = std::find_if(samples.begin(), samples.end(), [name](const Sample &s) { return s.name == name; });
+        if (it == samples.end()) {
+            it = samples.insert(samples.end(), Sample{name});
+        }
+        ++it->calls;
+        it->time += now.time - begin.time;
+        uint64_t enabled = now.enabled - begin.enabled;
+        uint64_t running = now.running - begin.running;
+        it->enabled += enabled;
+        it->running += running;
+        // Если группа за замер ни разу не считала, оценить нечего: этот замер уменьшит только долю `counted,%`
+        if (running == 0) {
+            return;
+        }
+        for (int i = 0; i < events; ++i) {
+            it->values[i] += uint64_t(double(now.values[i] - begin.values[i]) * double(enabled) / double(running));
+        }
+    }
+
+    /// Вызывается основным потоком в конце тика, пока остальные потоки простаивают
+    static void end_tick(int tick) {
+        if (enabled() and every_ > 0 and (tick + 1) % every_ == 0) {
+            report(tick);
+        }
+    }
+
+    /// Печатает замеры, накопленные после последней сводки
+    static void finish(int last_tick) {
+        if (enabled() and last_tick >= range_start_) {
+            report(last_tick);
+        }
+    }
+
+private:
+    static bool open(ThreadCounters &local) {
+        const auto &config = kind_ == Kind::hardware ? hardware_events : software_events;
+        for (auto [type, event]: config) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = event;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, local.leader, 0));
+            if (fd == -1) {
+                error_ = errno;
+                for (int opened: local.fds) {
+                    close(opened);
+                }
+                local.fds.clear();
+                local.leader = -1;
+                return false;
+            }
+            if (local.leader == -1) {
+                local.leader = fd;
+            }
+            local.fds.push_back(fd);
+        }
+        return true;
+    }
+
+    static ThreadCounters &counters() {
+        if (local_ == nullptr) {
+            std::lock_guard lock(mutex_);
+            auto &local = threads_.emplace_back(std::make_unique<ThreadCounters>());
+            if (kind_ != Kind::none) {
+                open(*local);
+            }
+            local_ = local.get();
+        }
+        return *local_;
+    }
+
+    static void report(int last_tick) {
+        std::lock_guard lock(mutex_);
+        std::vector<Sample> total;
+        for (auto &thread: threads_) {
+            for (auto &sample: thread->samples) {
+                auto it = std::find_if(total.begin(), total.end(), [&sample](const Sample &s) {
+                    return std::strcmp(s.name, sample.name) == 0;
+                });
+                if (it == total.end()) {
+                    it = total.insert(total.end(), Sample{sample.name});
+                }
+                it->calls += sample.calls;
+                it->time += sample.time;
+                it->enabled += sample.enabled;
+                it->running += sample.running;
+                for (int i = 0; i < events; ++i) {
+                    it->values[i] += sample.values[i];
+                }
+            }
+            thread->samples.clear();
+        }
+
+        const char *columns[events] = {"cycles", "instructions", "cache-misses", "branch-misses"};
+        if (kind_ == Kind::software) {
+            columns[0] = "task-clock,ns";
+            columns[1] = "page-faults";
+            columns[2] = "ctx-switches";
+            columns[3] = "migrations";
+        }
+        std::cout << "Perf counters, ticks " << range_start_ << "-" << last_tick << ":\n";
+        std::cout << std::left << std::setw(24) << "name" << std::right << std::setw(10) << "calls"
+                  << std::setw(12) << "time,ms";
+        if (kind_ != Kind::none) {
+            for (auto column: columns) {
+                std::cout << std::setw(16) << column;
+            }
+            if (kind_ == Kind::hardware) {
+                std::cout << std::setw(8) << "IPC";
+            }
+            std::cout << std::setw(12) << "counted,%";
+        }
+        std::cout << "\n";
+        for (const auto &sample: total) {
+            std::cout << std::left << std::setw(24) << sample.name << std::right << std::setw(10) << sample.calls
+                      << std::setw(12) << std::fixed << std::setprecision(2)
+                      << std::chrono::duration<double, std::milli>(sample.time).count();
+            if (kind_ != Kind::none) {
+                for (auto value: sample.values) {
+                    std::cout << std::setw(16) << value;
+                }
+                if (kind_ == Kind::hardware) {
+                    std::cout << std::setw(8) << double(sample.values[1]) / double(std::max<uint64_t>(1, sample.values[0]));
+                }
+                std::cout << std::setw(12)
+                          << 100 * double(sample.running) / double(std::max<uint64_t>(1, sample.enabled));
+            }
+            std::cout << "\n";
+        }
+        std::cout << std::defaultfloat;
+        std::cout.flush();
+        range_start_ = last_tick + 1;
+    }
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "page_memory.h"
+#include "utilities.h"
+
+namespace Emulator {
+    /// Генератор случайных чисел фазы перемещения
+    enum class RandomKind {
+        mt19937,
+        xoshiro,
+    };
+
+    inline RandomKind get_random_kind(const std::string &name) {
+        if (name == "mt19937") {
+            return RandomKind::mt19937;
+        }
+        if (name == "xoshiro") {
+            return RandomKind::xoshiro;
+        }
+        std::cout << "Error: random generator `" << name << "` not found" << std::endl;
+        exit(-1);
+    }
+
+    /// Несколько независимых потоков xoshiro256** в раскладке SoA: на каждом шаге все потоки обновляются одним и тем же
+    /// кодом без ветвлений, что компилятор превращает в SIMD-инструкции
+    class XoshiroLanes {
+    public:
+        static constexpr int lanes = 4;
+        /// Число 32-битных значений за один шаг всех потоков
+        static constexpr int block = 2 * lanes;
+
+    private:
+        alignas(64) std::array<std::array<uint64_t, lanes>, 4> s{};
+
+        static uint64_t splitmix64(uint64_t &x) {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+    public:
+        void seed(uint64_t seed) {
+            for (int l = 0; l < lanes; ++l) {
+                for (auto &state: s) {
+                    state[l] = splitmix64(seed);
+                }
+            }
+        }
+
+        /// Записывает `block` значений в out
+        void step(uint32_t *out) {
+            alignas(64) std::array<uint64_t, lanes> res;
+            for (int l = 0; l < lanes; ++l) {
+                res[l] = std::rotl(s[1][l] * 5, 7) * 9;
+                uint64_t t = s[1][l] << 17;
+                s[2][l] ^= s[0][l];
+                s[3][l] ^= s[1][l];
+                s[1][l] ^= s[2][l];
+                s[0][l] ^= s[3][l];
+                s[2][l] ^= t;
+                s[3][l] = std::rotl(s[3][l], 45);
+            }
+            for (int l = 0; l < lanes; ++l) {
+                out[2 * l] = uint32_t(res[l] >> 32);
+                out[2 * l + 1] = uint32_t(res[l]);
+            }
+        }
+    };
+
+    /// Буфер случайных чисел на тик. Пока идут первые фазы тика, `refill` на отдельном потоке дозаполняет буфер,
+    /// а `apply_move_on_flow` лишь читает из него. Неиспользованные значения переносятся на следующий тик, поэтому
+    /// последовательность чисел не зависит от размера буфера и момента заполнения: с `mt19937` она совпадает с
+    /// последовательными вызовами генератора
+    class RandomBatch {
+        RandomKind kind = RandomKind::mt19937;
+        std::mt19937 mt{1337};
+        XoshiroLanes xoshiro;
+
+        PageVector<uint32_t> buffer;
+        size_t pos = 0;
+        size_t filled = 0;
+
+    public:
+        void init(size_t capacity, RandomKind random_kind, uint64_t seed) {
+            kind = random_kind;
+            mt.seed(seed);
+            xoshiro.seed(seed);
+            capacity = (capacity + XoshiroLanes::block - 1) / XoshiroLanes::block * XoshiroLanes::block;
+            buffer.assign(capacity, 0);
+            pos = filled = 0;
+        }
+
+        void refill() {
+            std::copy(buffer.begin() + pos, buffer.begin() + filled, buffer.begin());
+            filled -= pos;
+            pos = 0;
+            if (kind == RandomKind::mt19937) {
+                for (; filled < buffer.size(); ++filled) {
+                    buffer[filled] = mt();
+                }
+                return;
+            }
+            for (; filled + XoshiroLanes::block <= buffer.size(); filled += XoshiroLanes::block) {
+                xoshiro.step(buffer.data() + filled);
+            }
+        }
+
+        template<typename T>
+        T next01() {
+            if (pos == filled) {
+                refill();
+            }
+            return random01<T>(buffer[pos++]);
+        }
+    };
+}
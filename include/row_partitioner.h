@@ -0,0 +1,163 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace Emulator {
+    /// Разбиение строк поля на непрерывные полосы примерно равной стоимости для одной параллельной фазы.
+    /// Стоимость строки сначала оценивается числом клеток без стен, затем уточняется замерами полос в прошедших тиках.
+    /// Число полос подбирается на первых тиках: каждый кандидат (от числа потоков до одной строки на полосу)
+    /// работает `trial_ticks` тиков, остаётся самый быстрый по времени всей фазы
+    class RowPartitioner {
+        static constexpr int trial_ticks = 8;
+        static constexpr int rebalance_ticks = 32;
+        static constexpr double smoothing = 0.25;
+
+        std::vector<double> cost;
+        std::vector<int> bounds{0, 0};
+        std::vector<int> previous;
+
+        std::vector<int> candidates;
+        std::vector<std::chrono::nanoseconds> candidate_time;
+        size_t candidate = 0;
+        int ticks = 0;
+        bool tuned = false;
+
+    public:
+        /// \param weights Начальная стоимость каждой строки
+        /// \param threads Число рабочих потоков
+        void init(std::vector<double> weights, int threads) {
+            cost = std::move(weights);
+            int rows = int(cost.size());
+            candidates.clear();
+            for (int chunks = threads; chunks < rows; chunks *= 2) {
+                candidates.push_back(chunks);
+            }
+            candidates.push_back(rows);
+            candidate_time.assign(candidates.size(), {});
+            bounds.reserve(rows + 1);
+            previous.reserve(rows + 1);
+            candidate = 0;
+            ticks = 0;
+            tuned = candidates.size() == 1;
+            rebalance(candidates[0]);
+        }
+
+        [[nodiscard]] int chunks() const {
+            return int(bounds.size()) - 1;
+        }
+
+        /// Полоса `i` - строки [begin(i), end(i))
+        [[nodiscard]] int begin(int i) const {
+            return bounds[i];
+        }
+
+        [[nodiscard]] int end(int i) const {
+            return bounds[i + 1];
+        }
+
+        /// Учитывает замеры прошедшего тика
+        /// \param chunk_time Время выполнения каждой полосы
+        /// \param phase_time Время всей фазы, включая ожидание потоков
+        /// \return Изменились ли границы полос
+        bool update(auto chunk_time, std::chrono::nanoseconds phase_time) {
+            for (int i = 0; i < chunks(); ++i) {
+                double estimated = 0;
+                for (int x = begin(i); x < end(i); ++x) {
+                    estimated += cost[x];
+                }
+                double measured = double(chunk_time(i).count());
+                if (estimated <= 0 or measured <= 0) {
+                    continue;
+                }
+                for (int x = begin(i); x < end(i); ++x) {
+                    cost[x] += smoothing * (cost[x] * measured / estimated - cost[x]);
+                }
+            }
+            ++ticks;
+
+            if (not tuned) {
+                // Первый тик кандидата идёт со старыми оценками, его не считаем
+                if (ticks > 1) {
+                    candidate_time[candidate] += phase_time;
+                }
+                if (ticks < trial_ticks) {
+                    return false;
+                }
+                ticks = 0;
+                if (++candidate == candidates.size()) {
+                    tuned = true;
+                    candidate = std::min_element(candidate_time.begin(), candidate_time.end()) - candidate_time.begin();
+                }
+                rebalance(candidates[candidate]);
+                return true;
+            }
+            if (ticks % rebalance_ticks != 0) {
+                return false;
+            }
+            previous = bounds;
+            rebalance(chunks());
+            return previous != bounds;
+        }
+
+        void report(std::ostream &out, const char *phase) const {
+            double total = 0;
+            double worst = 0;
+            for (int i = 0; i < chunks(); ++i) {
+                double sum = 0;
+                for (int x = begin(i); x < end(i); ++x) {
+                    sum += cost[x];
+                }
+                total += sum;
+                worst = std::max(worst, sum);
+            }
+            out << phase << ": " << chunks() << " chunks" << (tuned ? "" : " (tuning)");
+            if (total > 0) {
+                out << ", max/mean cost " << std::fixed << std::setprecision(2) << worst * chunks() / total
+                    << std::defaultfloat;
+            }
+            out << ", rows";
+            for (int i = 0; i < chunks(); ++i) {
+                out << " [" << begin(i) << "," << end(i) << ")";
+            }
+            out << "\n";
+            if (tuned) {
+                out << "  tried" << std::fixed << std::setprecision(1);
+                for (size_t i = 0; i < candidates.size(); ++i) {
+                    out << " " << candidates[i] << ":" << std::chrono::duration<double, std::micro>(
+                            candidate_time[i] / (trial_ticks - 1)).count() << "us";
+                }
+                out << std::defaultfloat << "\n";
+            }
+        }
+
+    private:
+        /// Жадно режет строки на `count` непрерывных полос, закрывая полосу, когда накопленная стоимость достигает
+        /// её доли от общей. Размер `bounds` не больше числа строк + 1, так что после первого вызова память не выделяется
+        void rebalance(int count) {
+            int rows = int(cost.size());
+            count = std::clamp(count, 1, std::max(rows, 1));
+            double total = 0;
+            for (double c: cost) {
+                total += c;
+            }
+            bounds.clear();
+            bounds.push_back(0);
+            double acc = 0;
+            for (int x = 0; x < rows; ++x) {
+                acc += cost[x];
+                int done = int(bounds.size()) - 1;
+                int left_rows = rows - x - 1;
+                int left_chunks = count - done - 1;
+                if (left_chunks > 0 and (acc >= total * (done + 1) / count or left_rows == left_chunks)) {
+                    bounds.push_back(x + 1);
+                }
+            }
+            bounds.push_back(rows);
+        }
+    };
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/// C API библиотеки `se2_fluid`: поле создаётся из текста карты в памяти, двигается на заданное число тиков, а его
+/// массивы читаются на месте, без копирования. Функции возвращают 0 при успехе и -1 при ошибке, текст ошибки -
+/// `se2_last_error()`. Одно поле нельзя вызывать из нескольких потоков одновременно
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(SE2_FLUID_BUILD)
+#define SE2_FLUID_API __attribute__((visibility("default")))
+#else
+#define SE2_FLUID_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct se2_field se2_field;
+
+typedef enum {
+    SE2_FIELD = 0,
+    SE2_P = 1,
+    SE2_VELOCITY = 2,
+    SE2_VELOCITY_FLOW = 3,
+} se2_array;
+
+/// Элемент `[x][y][d]` лежит по адресу `data + x * row_stride + y * col_stride + d * component_stride`, шаги в байтах.
+/// Клетки `field` - коды символов по байту, у `velocity` и `velocity_flow` по 4 компоненты - направления (dx, dy)
+/// (-1, 0), (1, 0), (0, -1), (0, 1). Для `FIXED` значения - целые со знаком с `frac_bits` дробными битами.
+/// Вид действителен до следующего `se2_step` или `se2_destroy`
+typedef struct {
+    const void *data;
+    int32_t rows;
+    int32_t cols;
+    int32_t components;
+    int64_t row_stride;
+    int64_t col_stride;
+    int64_t component_stride;
+    int32_t is_float;
+    int32_t value_size;
+    int32_t frac_bits;
+} se2_view;
+
+/// \param p_type, v_type, v_flow_type Типы как в опциях `--p-type` и т.п., например "FIXED(64,8)" или "DOUBLE"
+/// \param map Текст карты в формате файла поля, `map_size` байт
+/// \return Поле или NULL при ошибке
+SE2_FLUID_API se2_field *se2_create(const char *p_type, const char *v_type, const char *v_flow_type,
+                                    const char *map, size_t map_size);
+
+SE2_FLUID_API void se2_destroy(se2_field *field);
+
+/// Число рабочих потоков, задаётся до первого `se2_step` (по умолчанию 1)
+SE2_FLUID_API int se2_set_threads(se2_field *field, int threads);
+
+/// Seed генератора случайных чисел (по умолчанию 1337)
+SE2_FLUID_API int se2_set_seed(se2_field *field, uint64_t seed);
+
+SE2_FLUID_API int se2_step(se2_field *field, int ticks);
+
+SE2_FLUID_API int se2_get_view(se2_field *field, se2_array array, se2_view *view);
+
+/// Текст последней ошибки в вызывающем потоке
+SE2_FLUID_API const char *se2_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+#include "exporter.h"
+
+namespace Emulator {
+    /// Массивы состояния поля, которые можно читать снаружи
+    enum class StateArray {
+        field,
+        p,
+        velocity,
+        velocity_flow,
+    };
+
+    /// Массив состояния в памяти самого поля, без копирования. Элемент `[x][y][d]` лежит по адресу
+    /// `data + x * row_stride + y * col_stride + d * component_stride` (шаги в байтах). Для `FIXED` значения - целые
+    /// внутреннего представления с `frac_bits` дробными битами. Действителен до следующего тика или удаления поля
+    struct StateView {
+        const void *data = nullptr;
+        int rows = 0;
+        int cols = 0;
+        int components = 1;
+        ptrdiff_t row_stride = 0;
+        ptrdiff_t col_stride = 0;
+        ptrdiff_t component_stride = 0;
+        bool is_float = false;
+        int value_size = 0;
+        int frac_bits = 0;
+
+        /// Вид на первые `rows` x `cols` клеток массива `arr`. Пустой (`data == nullptr`) для блочной раскладки,
+        /// у которой нет постоянного шага по строкам
+        template<typename Value, int components = 1, typename Array>
+        static StateView of(Array &arr, int rows, int cols) {
+            StateView res;
+            if constexpr (std::is_pointer_v<decltype(arr[0])>) {
+                using raw = typename details::npy_type<Value>::raw;
+                static_assert(sizeof(raw) == sizeof(Value));
+                auto *begin = reinterpret_cast<const char *>(&arr[0][0]);
+                res.data = begin;
+                res.rows = rows;
+                res.cols = cols;
+                res.components = components;
+                res.row_stride = rows > 1 ? reinterpret_cast<const char *>(&arr[1][0]) - begin : 0;
+                res.col_stride = sizeof(arr[0][0]);
+                res.component_stride = sizeof(Value);
+                res.is_float = std::is_floating_point_v<raw>;
+                res.value_size = sizeof(raw);
+                res.frac_bits = details::npy_type<Value>::frac_bits;
+            }
+            return res;
+        }
+    };
+}
@@ -2,74 +2,174 @@
 
 
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <cstring>
+#include <istream>
+#include <type_traits>
+
+#include "page_memory.h"
 
 namespace Emulator {
-    template<typename Type, int N_val, int K_val>
+    /// Построчное хранение: `arr[N][K]` или один буфер по строкам
+    struct RowMajor {};
+
+    /// Хранение квадратными блоками B x B, каждый блок лежит в памяти подряд. Шаг по любому из 4-х направлений
+    /// внутри блока остаётся в пределах нескольких кэш-линий, что важно для обходов в `propagate_flow`/`propagate_move`
+    /// \tparam B Сторона блока, степень двойки
+    template<int B> requires (B > 0 && (B & (B - 1)) == 0)
+    struct Tiled {
+        static constexpr int side = B;
+
+        static constexpr int padded(int n) {
+            return (n + B - 1) / B * B;
+        }
+    };
+
+    /// Статический массив - ёмкость N_val x K_val, занятая часть `N` x `K` задаётся в `init`. Очистка и копирование
+    /// касаются только занятых строк
+    /// \tparam Storage Откуда берётся память динамических массивов (`PageAllocation`, `AlignedAllocation`).
+    /// Статические массивы лежат внутри объекта поля и только выровнены на кэш-линию, страницы для них выбирает
+    /// аллокатор самого поля (`PageAllocator`)
+    template<typename Type, int N_val, int K_val, typename Layout = RowMajor, typename Storage = PageAllocation>
     struct Array {
-        Type arr[N_val][K_val]{};
+        alignas(MemoryPolicy::alignment) Type arr[N_val][K_val]{};
         int N = N_val;
         int K = K_val;
 
-        void init(int n, int k) {}
+        void init(int n, int k) {
+            N = n;
+            K = k;
+        }
 
         void clear() {
-            std::memset(arr, 0, sizeof(arr));
+            std::memset(arr, 0, N * sizeof(arr[0]));
         }
 
         Type *operator[](int n) {
             return arr[n];
         }
 
+        /// `madvise` для страниц строк [begin, end)
+        void advise_rows(int begin, int end, int advice) {
+            advise(arr + begin, arr + end, advice);
+        }
+
         Array &operator=(const Array &other) {
             if (this == &other) {
                 return *this;
             }
-            std::memcpy(arr, other.arr, sizeof(arr));
+            N = other.N;
+            K = other.K;
+            std::memcpy(arr, other.arr, N * sizeof(arr[0]));
             return *this;
         }
     };
 
-    template<typename Type>
-    struct Array<Type, -1, -1> {
-        std::vector<std::vector<Type>> arr{};
+    /// Динамический размер: один непрерывный буфер по строкам
+    template<typename Type, typename Storage>
+    struct Array<Type, -1, -1, RowMajor, Storage> {
+        Buffer<Type, Storage> arr{};
         int N = 0;
         int K = 0;
 
         void init(int n, int k) {
             N = n;
             K = k;
+            arr.assign(size_t(n) * k);
+        }
 
-            if constexpr (std::is_copy_constructible_v<Type>) {
-                arr.assign(n, std::vector<Type>(k, Type{}));
-            } else {
-                arr.resize(n);
-                for (auto &line: arr) {
-                    std::vector<Type> tmp(k);
-                    line.swap(tmp);
-                }
+        void clear() {
+            arr.fill(Type{});
+        }
+
+        Type *operator[](int n) {
+            return arr.data() + size_t(n) * K;
+        }
+
+        void advise_rows(int begin, int end, int advice) {
+            advise(arr.data() + size_t(begin) * K, arr.data() + size_t(end) * K, advice);
+        }
+
+        Array &operator=(const Array &other) {
+            if (this == &other) {
+                return *this;
+            }
+            N = other.N;
+            K = other.K;
+            arr = other.arr;
+            return *this;
+        }
+    };
+
+    /// Блочное хранение. Доступ `arr[x][y]` сохранён за счёт прокси-строки
+    template<typename Type, int N_val, int K_val, int B, typename Storage>
+    struct Array<Type, N_val, K_val, Tiled<B>, Storage> {
+        using layout = Tiled<B>;
+        static constexpr bool is_static = N_val != -1;
+
+        alignas(MemoryPolicy::alignment) std::conditional_t<is_static,
+                std::array<Type, is_static ? layout::padded(N_val) * layout::padded(K_val) : 1>,
+                Buffer<Type, Storage>> arr{};
+        int N = N_val;
+        int K = K_val;
+        int tiles_k = is_static ? layout::padded(K_val) / B : 0;
+
+        class Row {
+            Type *base;
+        public:
+            explicit Row(Type *base) : base(base) {}
+
+            Type &operator[](int y) const {
+                return base[(unsigned(y) / B) * (B * B) + unsigned(y) % B];
+            }
+        };
+
+        void init(int n, int k) {
+            N = n;
+            K = k;
+            if constexpr (not is_static) {
+                tiles_k = layout::padded(k) / B;
+                arr.assign(size_t(layout::padded(n)) * layout::padded(k));
             }
         }
 
         void clear() {
-            arr = std::vector(N, std::vector<Type>(K, Type{}));
+            if constexpr (std::is_trivially_copyable_v<Type>) {
+                std::memset(arr.data(), 0, arr.size() * sizeof(Type));
+            } else {
+                std::fill(arr.begin(), arr.end(), Type{});
+            }
         }
 
-        std::vector<Type> &operator[](int n) {
-            return arr[n];
+        Row operator[](int x) {
+            return Row(arr.data() + (size_t(unsigned(x) / B) * tiles_k * B + unsigned(x) % B) * B);
+        }
+
+        /// Блоки хранятся полосами по B строк, поэтому задеваются целые полосы
+        void advise_rows(int begin, int end, int advice) {
+            size_t band = size_t(tiles_k) * B * B;
+            advise(arr.data() + begin / B * band, arr.data() + (end + B - 1) / B * band, advice);
         }
 
         Array &operator=(const Array &other) {
             if (this == &other) {
                 return *this;
             }
-            arr = other.arr;
+            if constexpr (is_static) {
+                std::memcpy(arr.data(), other.arr.data(), arr.size() * sizeof(Type));
+            } else {
+                N = other.N;
+                K = other.K;
+                tiles_k = other.tiles_k;
+                arr = other.arr;
+            }
             return *this;
         }
     };
 
-    template<typename Type, int N, int K>
-    void load_array(Array<Type, N, K> &arr, std::ifstream &file, int n, int k) {
+    template<typename Type, int N, int K, typename Layout, typename Storage>
+    void load_array(Array<Type, N, K, Layout, Storage> &arr, std::istream &file, int n, int k) {
         arr.init(n, k);
         for (int i = 0; i < arr.N; i++) {
             for (int j = 0; j < arr.K; j++) {
@@ -86,8 +186,8 @@ namespace Emulator {
         }
     }
 
-    template<typename Type, int N, int K>
-    void load_array(Array<std::array<Type, 4>, N, K> &arr, std::ifstream &file, int n, int k) {
+    template<typename Type, int N, int K, typename Layout, typename Storage>
+    void load_array(Array<std::array<Type, 4>, N, K, Layout, Storage> &arr, std::istream &file, int n, int k) {
         arr.init(n, k);
         for (int i = 0; i < arr.N; i++) {
             for (int j = 0; j < arr.K; j++) {
@@ -1,102 +1,193 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
+
 #include "utilities.h"
 
 class Task {
 public:
     virtual void doit() = 0;
 
+    /// Имя задачи на временной шкале `Tracer`
+    [[nodiscard]] virtual const char *name() const = 0;
+
     virtual ~Task() = default;
 };
 
+/// Задача над строками [begin, end). Время последнего выполнения нужно `RowPartitioner` для уточнения стоимости строк
+class RowTask : public Task {
+public:
+    int begin;
+    int end;
+    std::chrono::nanoseconds elapsed{0};
+
+    RowTask(int begin, int end) : begin(begin), end(end) {};
+
+    void doit() final {
+        auto start = std::chrono::steady_clock::now();
+        for (int x = begin; x < end; ++x) {
+            row(x);
+        }
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+
+protected:
+    virtual void row(int x) = 0;
+};
+
 template<typename T>
-class ApplyGTask : public Task {
+class ApplyGTask : public RowTask {
     T *field;
-    int x;
 public:
-    ApplyGTask(int x, T &field) : field(&field), x(x) {};
+    ApplyGTask(int begin, int end, T &field) : RowTask(begin, end), field(&field) {};
 
-    void doit() override;
+    void row(int x) override;
+
+    [[nodiscard]] const char *name() const override {
+        return "ApplyGTask";
+    }
 };
 
 template<typename T>
-void ApplyGTask<T>::doit() {
+void ApplyGTask<T>::row(int x) {
+    field->prefetch_ahead(x);
     auto G = Emulator::g<typename T::v_type>();
-    for (int y = 0; y < field->K; ++y) {
-        if (field->field[x][y] == '#')
+    auto [begin, end] = field->open_columns(x);
+    for (int y = begin; y < end; ++y) {
+        if (field->is_wall(x, y))
             continue;
-        if (field->field[x + 1][y] != '#')
-            field->velocity.add(x, y, 1, 0, G);
+        if (not field->is_wall(x + 1, y))
+            field->velocity.add(x, y, Emulator::Direction<Emulator::direction(1, 0)>{}, G);
     }
 }
 
 template<typename T>
-class ApplyPTask : public Task {
+class ApplyPTask : public RowTask {
     T *f;
-    int x;
 public:
-    ApplyPTask(int x, T &field) : f(&field), x(x) {};
+    ApplyPTask(int begin, int end, T &field) : RowTask(begin, end), f(&field) {};
 
-    void doit() override;
+    void row(int x) override;
+
+    [[nodiscard]] const char *name() const override {
+        return "ApplyPTask";
+    }
 };
 
 template<typename T>
-void ApplyPTask<T>::doit() {
-    for (int y = 0; y < f->K; ++y) {
-        if (f->field[x][y] == '#')
+void ApplyPTask<T>::row(int x) {
+    f->prefetch_ahead(x);
+    auto [begin, end] = f->open_columns(x);
+    for (int y = begin; y < end; ++y) {
+        if (f->is_wall(x, y))
             continue;
-        for (auto [dx, dy]: Emulator::deltas) {
-            int nx = x + dx, ny = y + dy;
-            if (f->field[nx][ny] == '#' or f->old_p[nx][ny] >= f->old_p[x][y]) {
-                continue;
+        Emulator::for_each_direction([&](auto dir) {
+            int nx = x + dir.dx, ny = y + dir.dy;
+            // Ребро обрабатывает только клетка с большим `old_p`, поэтому скорости по обе стороны ребра меняет одна
+            // задача. Сравнение записано через `<`, чтобы при NaN ребро пропустили обе клетки, а не взяли обе
+            if (f->is_wall(nx, ny) or not(f->old_p[nx][ny] < f->old_p[x][y])) {
+                return;
             }
             auto force = f->old_p[x][y] - f->old_p[nx][ny];
-            auto &contr = f->velocity.get(nx, ny, -dx, -dy);
+            auto &contr = f->velocity.get(nx, ny, dir.opposite());
             const auto &tmp = typename T::p_type(contr) * f->rho[(int) f->field[nx][ny]];
             if (tmp >= force) {
                 contr -= typename T::v_type(force / f->rho[(int) f->field[nx][ny]]);
-                continue;
+                return;
             }
             force -= tmp;
             contr = int64_t(0);
-            f->velocity.add(x, y, dx, dy, typename T::v_type(force / f->rho[(int) f->field[x][y]]));
-            f->p[x][y] -= force / f->dirs[x][y];
-        }
+            f->velocity.add(x, y, dir, typename T::v_type(force / f->rho[(int) f->field[x][y]]));
+            f->p[x][y] -= force / f->meta[x][y].dirs();
+        });
     }
 }
 
 
+/// Первая половина пересчёта `p`: клетка строки `x` сбрасывает свои скорости до потока и записывает вклады в `p`
+/// в свой буфер `p_out`, по направлению, не трогая `p` соседей
 template<typename T>
-class RecalcPTask : public Task {
+class RecalcPTask : public RowTask {
     T *f;
-    int x;
 public:
-    RecalcPTask(int x, T &field) : f(&field), x(x) {};
+    RecalcPTask(int begin, int end, T &field) : RowTask(begin, end), f(&field) {};
 
-    void doit() override;
+    void row(int x) override;
+
+    [[nodiscard]] const char *name() const override {
+        return "RecalcPTask";
+    }
 };
 
 template<typename T>
-void RecalcPTask<T>::doit() {
-    for (int y = 0; y < f->K; ++y) {
-        if (f->field[x][y] == '#')
+void RecalcPTask<T>::row(int x) {
+    f->prefetch_ahead(x);
+    auto [begin, end] = f->open_columns(x);
+    for (int y = begin; y < end; ++y) {
+        if (f->is_wall(x, y))
             continue;
-        for (auto [dx, dy]: Emulator::deltas) {
-            auto &old_v = f->velocity.get(x, y, dx, dy);
-            const auto &new_v = f->velocity_flow.get(x, y, dx, dy);
+        uint8_t mask = 0;
+        Emulator::for_each_direction([&](auto dir) {
+            int nx = x + dir.dx, ny = y + dir.dy;
+            auto &old_v = f->velocity.get(x, y, dir);
+            const auto &new_v = f->velocity_flow.get(x, y, dir);
             if (old_v > int64_t(0)) {
                 assert(typename T::v_type(new_v) <= old_v);
                 auto force = typename T::p_type(old_v - typename T::v_type(new_v)) * f->rho[(int) f->field[x][y]];
                 old_v = typename T::v_type(new_v);
                 if (f->field[x][y] == '.')
                     force *= 0.8;
-                if (f->field[x + dx][y + dy] == '#') {
-                    f->update_p(x, y, force / f->dirs[x][y]);
+                if (f->is_wall(nx, ny)) {
+                    f->p_out[x][y][dir.index] = force / f->meta[x][y].dirs();
                 } else {
-                    f->update_p(x + dx, y + dy, force / f->dirs[x + dx][y + dy]);
+                    f->p_out[x][y][dir.index] = force / f->meta[nx][ny].dirs();
                 }
+                mask |= 1 << dir.index;
             }
-        }
+        });
+        f->p_out_mask[x][y] = mask;
+    }
+}
+
+/// Вторая половина пересчёта `p`: клетка строки `x` прибавляет к своему `p` вклады из буферов `p_out` в том же
+/// порядке, в каком их прибавлял бы последовательный обход по строкам: от соседа сверху, слева, свои, справа, снизу.
+/// Поэтому результат не зависит от числа потоков и для типов с плавающей точкой
+template<typename T>
+class GatherPTask : public RowTask {
+    T *f;
+public:
+    GatherPTask(int begin, int end, T &field) : RowTask(begin, end), f(&field) {};
+
+    void row(int x) override;
+
+    [[nodiscard]] const char *name() const override {
+        return "GatherPTask";
+    }
+};
+
+template<typename T>
+void GatherPTask<T>::row(int x) {
+    f->prefetch_ahead(x);
+    auto [begin, end] = f->open_columns(x);
+    for (int y = begin; y < end; ++y) {
+        if (f->is_wall(x, y))
+            continue;
+        auto take = [&](int sx, int sy, int d) {
+            if (not f->is_wall(sx, sy) and f->p_out_mask[sx][sy] & (1 << d)) {
+                f->p[x][y] += f->p_out[sx][sy][d];
+            }
+        };
+        using Emulator::Direction, Emulator::direction;
+        take(x - 1, y, Direction<direction(1, 0)>::index);
+        take(x, y - 1, Direction<direction(0, 1)>::index);
+        Emulator::for_each_direction([&](auto dir) {
+            if (f->is_wall(x + dir.dx, y + dir.dy)) {
+                take(x, y, dir.index);
+            }
+        });
+        take(x, y + 1, Direction<direction(0, -1)>::index);
+        take(x + 1, y, Direction<direction(-1, 0)>::index);
     }
 }
 
@@ -107,11 +198,19 @@ public:
     explicit OutFieldTask(T &field) : f(&field) {};
 
     void doit() override;
+
+    [[nodiscard]] const char *name() const override {
+        return "OutFieldTask";
+    }
 };
 
 template<typename T>
 void OutFieldTask<T>::doit() {
-    std::cout << "Tick " << f->last_active << ":\n";
+    if (not f->print_pending) {
+        return;
+    }
+    f->print_pending = false;
+    std::cout << "Tick " << f->output_tick << ":\n";
     for (int j = 0; j < f->N; j++) {
         for (int k = 0; k < f->K; k++) {
             std::cout << f->field[j][k];
@@ -119,4 +218,42 @@ void OutFieldTask<T>::doit() {
         std::cout << "\n";
     }
     std::cout.flush();
-}
\ No newline at end of file
+}
+
+template<typename T>
+class ExportTask : public Task {
+    T *f;
+public:
+    explicit ExportTask(T &field) : f(&field) {};
+
+    void doit() override;
+
+    [[nodiscard]] const char *name() const override {
+        return "ExportTask";
+    }
+};
+
+template<typename T>
+void ExportTask<T>::doit() {
+    if (f->exporter) {
+        f->exporter->write();
+    }
+}
+
+template<typename T>
+class RandomFillTask : public Task {
+    T *f;
+public:
+    explicit RandomFillTask(T &field) : f(&field) {};
+
+    void doit() override;
+
+    [[nodiscard]] const char *name() const override {
+        return "RandomFillTask";
+    }
+};
+
+template<typename T>
+void RandomFillTask<T>::doit() {
+    f->random.refill();
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "perf_counters.h"
+
+/// Запись временной шкалы в формате Chrome trace event (открывается в `chrome://tracing` и Perfetto). События пишутся
+/// в буфер своего потока без блокировок, общий мьютекс берётся только при первом событии потока
+class Tracer {
+    struct Event {
+        const char *name;
+        const char *category;
+        int64_t ts;
+        char phase;
+    };
+
+    struct ThreadBuffer {
+        int tid = 0;
+        std::string name;
+        std::vector<Event> events;
+    };
+
+    static inline std::atomic<bool> enabled_ = false;
+    static inline std::string path_;
+    static inline std::chrono::steady_clock::time_point start_;
+    static inline std::mutex mutex_;
+    static inline std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+    static inline thread_local ThreadBuffer *buffer_ = nullptr;
+
+public:
+    [[nodiscard]] static bool enabled() {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    /// Начинает запись, вызывающий поток считается основным. Потоки, созданные раньше, останутся без имён
+    static void start(const std::string &path) {
+        path_ = path;
+        start_ = std::chrono::steady_clock::now();
+        enabled_ = true;
+        thread_name("main");
+    }
+
+    /// Имя текущего потока на временной шкале
+    static void thread_name(const std::string &name) {
+        if (not enabled()) {
+            return;
+        }
+        local().name = name;
+    }
+
+    static void begin(const char *name, const char *category) {
+        record(name, category, 'B');
+    }
+
+    static void end(const char *name, const char *category) {
+        record(name, category, 'E');
+    }
+
+    /// Останавливает запись и сохраняет её. Вызывать, когда остальные потоки простаивают
+    static void stop() {
+        if (not enabled()) {
+            return;
+        }
+        enabled_ = false;
+
+        std::ofstream out(path_);
+        if (not out.is_open()) {
+            std::cout << "Error: can`t open file `" << path_ << "`" << std::endl;
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        int pid = getpid();
+        bool first = true;
+        auto separator = [&]() -> std::ofstream & {
+            out << (first ? "\n" : ",\n");
+            first = false;
+            return out;
+        };
+        out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        for (const auto &buffer: buffers_) {
+            separator() << R"({"name": "thread_name", "ph": "M", "pid": )" << pid << ", \"tid\": " << buffer->tid
+                        << R"(, "args": {"name": ")" << buffer->name << "\"}}";
+            for (const auto &event: buffer->events) {
+                separator() << "{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category
+                            << "\", \"ph\": \"" << event.phase << "\", \"ts\": " << double(event.ts) / 1000
+                            << ", \"pid\": " << pid << ", \"tid\": " << buffer->tid << "}";
+            }
+        }
+        out << "\n]}\n";
+    }
+
+private:
+    static ThreadBuffer &local() {
+        if (buffer_ == nullptr) {
+            std::lock_guard lock(mutex_);
+            auto &buffer = buffers_.emplace_back(std::make_unique<ThreadBuffer>());
+            buffer->tid = int(buffers_.size());
+            buffer->name = "thread " + std::to_string(buffer->tid);
+            buffer->events.reserve(1 << 16);
+            buffer_ = buffer.get();
+        }
+        return *buffer_;
+    }
+
+    static void record(const char *name, const char *category, char phase) {
+        if (not enabled()) {
+            return;
+        }
+        auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_);
+        local().events.push_back({name, category, ts.count(), phase});
+    }
+};
+
+/// Отрезок временной шкалы от создания до разрушения объекта. Он же замеряется `PerfCounters`, если они включены
+class TraceScope {
+    const char *name;
+    const char *category;
+    bool active;
+    bool counted;
+    PerfCounters::Reading begin{};
+
+public:
+    TraceScope(const char *name, const char *category)
+            : name(name), category(category), active(Tracer::enabled()), counted(PerfCounters::enabled()) {
+        if (active) {
+            Tracer::begin(name, category);
+        }
+        if (counted) {
+            begin = PerfCounters::read();
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+
+    ~TraceScope() {
+        if (counted) {
+            PerfCounters::add(name, begin);
+        }
+        if (active) {
+            Tracer::end(name, category);
+        }
+    }
+};
@@ -1,22 +1,59 @@
 #pragma once
 
+#include <cstdint>
 #include <utility>
 #include <random>
 #include <array>
+#include <type_traits>
 
 namespace Emulator {
-    static std::mt19937 rnd(1337);
     constexpr std::array<std::pair<int, int>, 4> deltas{{{-1, 0}, {1, 0}, {0, -1}, {0, 1}}};
 
+    /// Индекс направления (dx, dy) в `deltas`
+    constexpr int direction(int dx, int dy) {
+        return dx != 0 ? dx > 0 : 2 + (dy > 0);
+    }
+
+    /// Направление `deltas[D]`, известное при компиляции. Смещения и обратное направление - константы
+    template<int D>
+    struct Direction {
+        static_assert(D >= 0 and D < int(deltas.size()));
+
+        static constexpr int index = D;
+        static constexpr int dx = deltas[D].first;
+        static constexpr int dy = deltas[D].second;
+
+        static constexpr Direction<D ^ 1> opposite() {
+            return {};
+        }
+    };
+
+    static_assert(direction(deltas[0].first, deltas[0].second) == 0 and direction(deltas[3].first, deltas[3].second) == 3);
+    static_assert(Direction<2>::opposite().dx == 0 and Direction<2>::opposite().dy == 1);
+
+    /// Вызывает `f(Direction<D>{})` для всех направлений по порядку `deltas`, цикл развёрнут при компиляции.
+    /// Если `f` возвращает bool, обход останавливается на первом `true`, а результат - был ли такой вызов
+    template<typename F>
+    constexpr auto for_each_direction(F &&f) {
+        return [&f]<int... D>(std::integer_sequence<int, D...>) {
+            if constexpr ((std::is_void_v<decltype(f(Direction<D>{}))> and ...)) {
+                (f(Direction<D>{}), ...);
+            } else {
+                return (bool(f(Direction<D>{})) or ...);
+            }
+        }(std::make_integer_sequence<int, int(deltas.size())>{});
+    }
+
     template<typename T>
     T g() { return 0.1; };
 
+    /// Превращает 32 случайных бита в число из [0, 1] так же, как это делалось для выхода `std::mt19937`
     template<typename T>
-    T random01() {
+    T random01(uint32_t bits) {
         if constexpr (std::is_same_v<T, float> or std::is_same_v<T, double>) {
-            return T(rnd()) / T(std::mt19937::max());
+            return T(bits) / T(std::mt19937::max());
         } else {
-            return T::from_raw((rnd() & ((1LL << T::k) - 1LL)));
+            return T::from_raw((bits & ((1LL << T::k) - 1LL)));
         }
     }
 }
\ No newline at end of file
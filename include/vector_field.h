@@ -8,25 +8,32 @@
 #include "static_array.h"
 
 namespace Emulator {
-    template<typename T, int N, int K>
+    template<typename T, int N, int K, typename Layout = RowMajor>
     struct VectorField {
-        Array<std::array<T, deltas.size()>, N, K> v;
+        Array<std::array<T, deltas.size()>, N, K, Layout> v;
 
-        T &add(int x, int y, int dx, int dy, T dv) {
-            return get(x, y, dx, dy) += dv;
+        template<int D>
+        T &get(int x, int y) {
+            return v[x][y][D];
         }
 
-        T &get(int x, int y, int dx, int dy) {
-            switch ((dx << 1) + dy) {
-                case 1:
-                    return v[x][y][3];
-                case 2:
-                    return v[x][y][1];
-                case -1:
-                    return v[x][y][2];
-                default:
-                    return v[x][y][0];
-            }
+        template<int D>
+        T &get(int x, int y, Direction<D>) {
+            return v[x][y][D];
+        }
+
+        /// \param d Индекс направления в `deltas`
+        T &get(int x, int y, int d) {
+            return v[x][y][d];
+        }
+
+        template<int D>
+        T &add(int x, int y, Direction<D> dir, T dv) {
+            return get(x, y, dir) += dv;
+        }
+
+        T &add(int x, int y, int d, T dv) {
+            return get(x, y, d) += dv;
         }
     };
 }
\ No newline at end of file
@@ -2,26 +2,43 @@
 
 
 #include <atomic>
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <thread>
 #include "tasks.h"
+#include "tracer.h"
 
 class WorkerHandler {
 private:
     int workers = 0;
     bool is_active = false;
+    const char *name = "worker";
+    std::vector<std::thread> threads;
+    std::atomic<bool> stopping = false;
 public:
     std::atomic<std::vector<std::unique_ptr<Task>> *> atomic_tasks = nullptr;
+    std::atomic<size_t> count = 0;
     std::atomic<int> ind = 0;
     std::atomic<int> finish = 0;
     std::atomic<int> start = 0;
 
     WorkerHandler() = default;
 
-    void init(int n);
+    WorkerHandler(const WorkerHandler &) = delete;
 
-    void set_tasks(std::vector<std::unique_ptr<Task>> *);
+    /// Будит простаивающие потоки и дожидается их выхода. Задачи к этому моменту должны быть завершены
+    ~WorkerHandler();
+
+    /// \param name Имя потоков на временной шкале `Tracer`
+    void init(int n, const char *name = "worker");
+
+    [[nodiscard]] bool is_initialized() const {
+        return workers > 0;
+    }
+
+    /// Раздаёт потокам первые `count` задач из `tasks`
+    void set_tasks(std::vector<std::unique_ptr<Task>> *tasks, size_t count = SIZE_MAX);
 
     void wait_until_end();
 
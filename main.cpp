@@ -22,22 +22,58 @@ int main(int argc, char **argv) {
 
     int workers = std::stoi(args.get_option("--threads-count"));
 
-    int T = 1'000'000;
+    // По умолчанию 10'001 тик, как и раньше
+    int T = std::stoi(args.get_option("--ticks", "10001"));
 
     auto [N, K, t] = read_field_params(filename);
 
-    auto field = get_field(type_p, type_v, type_vf, N, K);
+    Emulator::MemoryPolicy::pages = Emulator::get_huge_pages(args.get_option("--huge-pages", "off"));
+    Emulator::MemoryPolicy::backing_dir = args.get_option("--backing-dir", "");
+    int map = args.get_option("--embedded-map", "auto") == "off" ? -1 : Emulator::find_embedded_map(filename);
+
+    auto field = get_field(type_p, type_v, type_vf, N, K, map);
+
+    std::string trace = args.get_option("--trace", "");
+    if (not trace.empty()) {
+        Tracer::start(trace);
+    }
+
+    std::string perf = args.get_option("--perf-counters", "");
+    if (not perf.empty()) {
+        PerfCounters::start(std::stoi(perf));
+    }
 
     field->load(filename);
     field->init_workers(workers);
+    field->set_flow_solver(Emulator::get_flow_solver(args.get_option("--flow-solver", "dfs")));
+    field->set_flow_warm_start(Emulator::get_flow_warm_start(args.get_option("--flow-start", "cold")));
+    field->set_random(Emulator::get_random_kind(args.get_option("--rng", "mt19937")),
+                      std::stoull(args.get_option("--seed", "1337")));
+    field->set_output(Emulator::OutputPolicy(args.get_option("--output", "changes")));
+    field->set_pressure_log(args.get_option("--log-p", "0") == "1");
+    field->set_stats(args.get_option("--stats", "0") == "1");
+    if (args.get_option("--heatmap", "0") == "1") {
+        field->set_heatmap(filename);
+    }
 
-    auto timer = std::chrono::steady_clock::now();
-    for (int i = 0; i < T; ++i) {
-        field->next(i);
-        if (i == 10'000) {
-            break;
-        }
+    Emulator::ExportOptions export_options;
+    export_options.prefix = args.get_option("--export", "");
+    export_options.set_fields(args.get_option("--export-fields", "p,velocity,velocity_flow"));
+    export_options.stride = std::max(1, std::stoi(args.get_option("--export-stride", "1")));
+    export_options.every = std::max(1, std::stoi(args.get_option("--export-every", "1")));
+    field->set_export(export_options);
+
+    Emulator::RunOptions run_options;
+    run_options.progress_every = std::stoi(args.get_option("--progress", "0"));
+    std::function<void(int)> progress;
+    if (run_options.progress_every > 0) {
+        progress = [T](int i) { std::cerr << "Progress: " << i + 1 << "/" << T << std::endl; };
     }
+
+    auto timer = std::chrono::steady_clock::now();
+    field->run(T, run_options, progress);
+    field->finish();
+    Tracer::stop();
     std::cout << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - timer).count()
               << std::endl;
 }
\ No newline at end of file
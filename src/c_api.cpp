@@ -0,0 +1,153 @@
+#include "../include/se2_fluid.h"
+#include "../include/fields_factory.h"
+
+#include <exception>
+#include <sstream>
+#include <string>
+
+struct se2_field {
+    std::shared_ptr<Emulator::AbstractField> field;
+    int threads = 1;
+    int tick = 0;
+    bool started = false;
+};
+
+namespace {
+    thread_local std::string last_error;
+
+    int fail(const std::string &message) {
+        last_error = message;
+        return -1;
+    }
+
+    /// Проверяет заголовок и число клеток карты, чтобы `load` не завершал процесс на неверном буфере
+    bool read_size(const std::string &map, int &N, int &K) {
+        std::istringstream in(map);
+        int t, ut;
+        if (not(in >> N >> K >> t >> ut) or N <= 0 or K <= 0) {
+            return false;
+        }
+        for (int64_t i = 0; i < int64_t(N) * K; ++i) {
+            int cell;
+            if (not(in >> cell)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template<typename F>
+    int guarded(F &&f) {
+        try {
+            return f();
+        } catch (const std::exception &e) {
+            return fail(e.what());
+        }
+    }
+}
+
+se2_field *se2_create(const char *p_type, const char *v_type, const char *v_flow_type, const char *map,
+                      size_t map_size) {
+    if (p_type == nullptr or v_type == nullptr or v_flow_type == nullptr or map == nullptr) {
+        fail("null argument");
+        return nullptr;
+    }
+    for (const char *type: {p_type, v_type, v_flow_type}) {
+        if (not Emulator::TypeEncoder::has_type(type)) {
+            fail(std::string("type `") + type + "` not found");
+            return nullptr;
+        }
+    }
+    std::string text(map, map_size);
+    int N, K;
+    if (not read_size(text, N, K)) {
+        fail("malformed map");
+        return nullptr;
+    }
+
+    se2_field *res = nullptr;
+    guarded([&] {
+        auto field = get_field(Emulator::TypeEncoder::get_type(p_type), Emulator::TypeEncoder::get_type(v_type),
+                               Emulator::TypeEncoder::get_type(v_flow_type), N, K);
+        std::istringstream in(text);
+        field->load(in);
+        field->set_output(Emulator::OutputPolicy("none"));
+        res = new se2_field{std::move(field)};
+        return 0;
+    });
+    return res;
+}
+
+void se2_destroy(se2_field *field) {
+    if (field == nullptr) {
+        return;
+    }
+    if (field->started) {
+        field->field->finish();
+    }
+    delete field;
+}
+
+int se2_set_threads(se2_field *field, int threads) {
+    if (field == nullptr) {
+        return fail("null field");
+    }
+    if (field->started) {
+        return fail("threads must be set before the first step");
+    }
+    if (threads < 1) {
+        return fail("must be at least 1 thread");
+    }
+    field->threads = threads;
+    return 0;
+}
+
+int se2_set_seed(se2_field *field, uint64_t seed) {
+    if (field == nullptr) {
+        return fail("null field");
+    }
+    return guarded([&] {
+        field->field->set_random(Emulator::RandomKind::mt19937, seed);
+        return 0;
+    });
+}
+
+int se2_step(se2_field *field, int ticks) {
+    if (field == nullptr) {
+        return fail("null field");
+    }
+    if (ticks < 0) {
+        return fail("negative ticks count");
+    }
+    return guarded([&] {
+        if (not field->started) {
+            field->field->init_workers(field->threads);
+            field->started = true;
+        }
+        Emulator::RunOptions options;
+        options.first_tick = field->tick;
+        field->field->run(ticks, options);
+        field->tick += ticks;
+        return 0;
+    });
+}
+
+int se2_get_view(se2_field *field, se2_array array, se2_view *view) {
+    if (field == nullptr or view == nullptr) {
+        return fail("null argument");
+    }
+    if (array < SE2_FIELD or array > SE2_VELOCITY_FLOW) {
+        return fail("unknown array");
+    }
+    auto state = field->field->view(Emulator::StateArray(array));
+    if (state.data == nullptr) {
+        return fail("array layout has no constant row stride (FIELD_LAYOUT=Tiled)");
+    }
+    *view = {state.data, state.rows, state.cols, state.components, state.row_stride, state.col_stride,
+             state.component_stride, state.is_float, state.value_size, state.frac_bits};
+    return 0;
+}
+
+const char *se2_last_error() {
+    return last_error.c_str();
+}
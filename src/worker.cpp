@@ -1,26 +1,36 @@
+#include <algorithm>
 #include <iostream>
 #include "../include/workers.h"
 
 void WorkerHandler::_worker_impl(WorkerHandler &handler) {
+    Tracer::thread_name(handler.name);
+    Tracer::begin("idle", "wait");
     handler.start.wait(0);
+    Tracer::end("idle", "wait");
     int last_start = handler.start;
-    while (true) {
+    while (not handler.stopping) {
         auto tasks = handler.atomic_tasks.load();
         int my_ind = handler.ind.fetch_add(1);
-        if (my_ind >= tasks->size()) {
+        if (size_t(my_ind) >= handler.count) {
+            // Начало простоя пишется до сигнала о завершении, после него основной поток может сохранять запись
+            Tracer::begin("idle", "wait");
             handler.finish.fetch_add(1);
             handler.finish.notify_one();
             handler.start.wait(last_start);
+            Tracer::end("idle", "wait");
             last_start = handler.start;
             continue;
         }
-        tasks->at(my_ind)->doit();
+        auto &task = tasks->at(my_ind);
+        TraceScope scope(task->name(), "task");
+        task->doit();
     }
 }
 
-void WorkerHandler::set_tasks(std::vector<std::unique_ptr<Task>> *tasks) {
+void WorkerHandler::set_tasks(std::vector<std::unique_ptr<Task>> *tasks, size_t n) {
     is_active = true;
     ind.store(0);
+    count.store(std::min(n, tasks->size()));
     finish.store(0);
     atomic_tasks.store(tasks);
     start.fetch_add(1);
@@ -31,6 +41,7 @@ void WorkerHandler::wait_until_end() {
     if (not is_active) {
         return;
     }
+    TraceScope scope("wait_until_end", "wait");
     int last;
     while ((last = finish) != workers) {
         finish.wait(last);
@@ -38,10 +49,20 @@ void WorkerHandler::wait_until_end() {
     is_active = false;
 }
 
-void WorkerHandler::init(int n) {
+void WorkerHandler::init(int n, const char *thread_name) {
     workers = n;
+    name = thread_name;
     for (int i = 0; i < workers; i++) {
-        std::thread(_worker_impl, std::ref(*this)).detach();
+        threads.emplace_back(_worker_impl, std::ref(*this));
+    }
+}
+
+WorkerHandler::~WorkerHandler() {
+    stopping = true;
+    start.fetch_add(1);
+    start.notify_all();
+    for (auto &thread: threads) {
+        thread.join();
     }
 }
 
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+"""Генератор карт для SE2_CPP_HW2 и raw_fluid.
+
+Карта - прямоугольник в стенах, внутри которого:
+
+* препятствия - случайные прямоугольники из стен;
+* каналы - горизонтальные перегородки во всю ширину с узким проходом, через который жидкость стекает вниз;
+* бассейны - чаши из стен (дно и бока), заполненные жидкостью;
+* жидкость - сверху вниз по свободным клеткам, пока её доля среди всех клеток без стен не достигнет `--fluid`.
+
+Одинаковые параметры и `--seed` дают одинаковую карту.
+"""
+
+import argparse
+import random
+import sys
+
+WALL, AIR, FLUID = "#", " ", "."
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("rows", type=int)
+    parser.add_argument("cols", type=int)
+    parser.add_argument("--pools", type=int, default=2)
+    parser.add_argument("--channels", type=int, default=2)
+    parser.add_argument("--obstacles", type=int, default=8)
+    parser.add_argument("--fluid", type=float, default=0.3, help="доля жидкости среди клеток без стен")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--out", default="-", help="файл карты, `-` - stdout")
+    return parser.parse_args()
+
+
+def generate(rows, cols, pools=2, channels=2, obstacles=8, fluid=0.3, seed=1):
+    """Возвращает карту списком строк одинаковой длины `cols`"""
+    if rows < 5 or cols < 5:
+        raise ValueError("map must be at least 5x5")
+    rng = random.Random(seed)
+    grid = [[AIR] * cols for _ in range(rows)]
+    for x in range(rows):
+        grid[x][0] = grid[x][cols - 1] = WALL
+    for y in range(cols):
+        grid[0][y] = grid[rows - 1][y] = WALL
+
+    # Размеры деталей растут с картой, чтобы её вид не зависел от разрешения
+    scale = max(1, min(rows, cols) // 16)
+
+    for _ in range(obstacles):
+        height, width = rng.randint(1, scale), rng.randint(1, 2 * scale)
+        x, y = rng.randint(2, max(2, rows - 3 - height)), rng.randint(2, max(2, cols - 3 - width))
+        for i in range(x, min(rows - 2, x + height)):
+            for j in range(y, min(cols - 2, y + width)):
+                grid[i][j] = WALL
+
+    # Перегородки расставлены по нижним трём четвертям карты с равным шагом, чтобы не сливаться
+    step = (rows - 3 - rows // 4) / max(1, channels)
+    for i in range(channels):
+        x = rows // 4 + int(step * i) + rng.randint(0, max(0, int(step) - 2))
+        gap = max(1, scale // 2)
+        start = rng.randint(1, cols - 1 - gap)
+        for y in range(1, cols - 1):
+            if not start <= y < start + gap:
+                grid[x][y] = WALL
+
+    for _ in range(pools):
+        height, width = rng.randint(2, 2 + 2 * scale), rng.randint(3, 3 + 4 * scale)
+        width = min(width, cols - 2)
+        x, y = rng.randint(2, max(2, rows - 2 - height)), rng.randint(1, max(1, cols - 1 - width))
+        bottom = min(rows - 2, x + height)
+        for j in range(y, min(cols - 1, y + width)):
+            grid[bottom][j] = WALL
+        for i in range(x, bottom):
+            grid[i][y] = WALL
+            grid[i][min(cols - 2, y + width - 1)] = WALL
+            for j in range(y + 1, min(cols - 2, y + width - 1)):
+                grid[i][j] = FLUID
+
+    open_cells = sum(cell != WALL for row in grid for cell in row)
+    left = int(fluid * open_cells) - sum(cell == FLUID for row in grid for cell in row)
+    for x in range(1, rows - 1):
+        for y in range(1, cols - 1):
+            if left <= 0:
+                break
+            if grid[x][y] == AIR:
+                grid[x][y] = FLUID
+                left -= 1
+    return ["".join(row) for row in grid]
+
+
+def write(lines, out):
+    """Формат файла поля: `N K 0 0` и коды символов клеток по строкам"""
+    out.write("%d %d 0 0\n" % (len(lines), len(lines[0])))
+    for line in lines:
+        out.write(" ".join(str(ord(cell)) for cell in line))
+        out.write("\n")
+
+
+def main():
+    args = parse_args()
+    lines = generate(args.rows, args.cols, args.pools, args.channels, args.obstacles, args.fluid, args.seed)
+    if args.out == "-":
+        write(lines, sys.stdout)
+    else:
+        with open(args.out, "w") as file:
+            write(lines, file)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""Регрессионная проверка SE2_CPP_HW2 относительно raw_fluid и сохранённого эталона.
+
+Собирает обе программы, прогоняет их на одних и тех же картах и seed и сравнивает:
+
+* кадры (md5 каждого выведенного поля) и сумму `p` после каждого тика с эталоном из `--baseline`;
+* совпадение конфигураций на разном числе потоков;
+* SE2_CPP_HW2 с типами `raw_fluid` (FIXED(32,16)) против самого `raw_fluid`: первый расходящийся кадр не должен
+  наступать раньше, чем записано в эталоне (оптимизации из README меняют порядок обхода потока, поэтому полного
+  совпадения с `raw_fluid` нет и не ожидается);
+* с `--speed-ref REV` - скорость в тиках в секунду против коммита REV, собранного во временном `git worktree` и
+  прогнанного на этой же машине в этом же запуске: падение больше `--max-slowdown` считается ошибкой.
+
+Эталон перезаписывается флагом `--update`. Скорость в эталон не пишется: она зависит от машины.
+"""
+
+import argparse
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+RAW_TYPE = "FIXED(32,16)"
+RAW_SIZE = (94, 84)
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--build-dir", default=os.path.join(ROOT, "_regression_build"))
+    parser.add_argument("--baseline", default=os.path.join(ROOT, "tools", "regression_baseline.json"))
+    parser.add_argument("--maps", nargs="+", default=["field.txt"], help="карты относительно корня репозитория")
+    parser.add_argument("--configs", nargs="+",
+                        default=[f"{RAW_TYPE}/{RAW_TYPE}/{RAW_TYPE}", "FIXED(64,8)/FIXED(64,8)/FIXED(64,8)"],
+                        help="типы p/v/v-flow")
+    parser.add_argument("--threads", nargs="+", type=int, default=[1, 2])
+    parser.add_argument("--ticks", type=int, default=100)
+    parser.add_argument("--seed", type=int, default=1337)
+    parser.add_argument("--p-tolerance", type=float, default=1e-9, help="относительная погрешность суммы p")
+    parser.add_argument("--speed-ref", help="коммит, с которым сравнивается скорость, например origin/main")
+    parser.add_argument("--max-slowdown", type=float, default=0.2, help="допустимое падение тиков в секунду")
+    parser.add_argument("--repeats", type=int, default=3,
+                        help="прогонов на скорость с `--speed-ref`, берётся лучший у каждой версии")
+    parser.add_argument("--update", action="store_true", help="записать результаты как новый эталон")
+    parser.add_argument("--skip-build", action="store_true")
+    return parser.parse_args()
+
+
+def map_size(path):
+    with open(path) as file:
+        n, k = file.readline().split()[:2]
+    return int(n), int(k)
+
+
+def build(args, root, build_dir):
+    types = []
+    for config in args.configs:
+        for name in config.split("/") + [RAW_TYPE]:
+            if name not in types:
+                types.append(name)
+    sizes = []
+    for path in args.maps:
+        size = "S(%d,%d)" % map_size(os.path.join(ROOT, path))
+        if size not in sizes:
+            sizes.append(size)
+    subprocess.run(["cmake", "-S", root, "-B", build_dir, "-DFLUID_TYPES=" + ",".join(types),
+                    "-DFLUID_SIZES=" + ",".join(sizes)], check=True, stdout=subprocess.DEVNULL)
+    subprocess.run(["cmake", "--build", build_dir, "-j", str(os.cpu_count() or 1), "--target", "SE2_CPP_HW2",
+                    "raw_fluid"], check=True, stdout=subprocess.DEVNULL)
+
+
+def build_reference(args, workdir):
+    """Собирает `--speed-ref` в `git worktree` внутри `workdir` и возвращает путь к его SE2_CPP_HW2"""
+    tree = os.path.join(workdir, "tree")
+    subprocess.run(["git", "-C", ROOT, "worktree", "add", "--detach", tree, args.speed_ref],
+                   check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    build(args, tree, os.path.join(workdir, "build"))
+    return os.path.join(workdir, "build", "SE2_CPP_HW2")
+
+
+def run(command, rows):
+    """Запускает программу и возвращает кадры [(тик, md5)], суммы p по тикам и тики в секунду"""
+    start = time.perf_counter()
+    result = subprocess.run(command, capture_output=True, text=True)
+    elapsed = time.perf_counter() - start
+    if result.returncode != 0:
+        raise RuntimeError("`%s` exited with %d\n%s" % (" ".join(command), result.returncode, result.stdout[-500:]))
+
+    frames, pressure = [], []
+    lines = result.stdout.splitlines()
+    i = 0
+    while i < len(lines):
+        line = lines[i]
+        if line.startswith("Tick "):
+            frame = "\n".join(lines[i + 1:i + 1 + rows])
+            frames.append([int(line[5:-1]), hashlib.md5(frame.encode()).hexdigest()])
+            i += rows + 1
+            continue
+        if line.startswith("Pressure "):
+            pressure.append(float(line.split()[2]))
+        i += 1
+    return {"frames": frames, "pressure": pressure}, elapsed
+
+
+def first_divergence(a, b, tolerance):
+    """Первый тик, на котором расходятся кадры или суммы p, либо None"""
+    frame_tick = None
+    for (tick_a, hash_a), (tick_b, hash_b) in zip(a["frames"], b["frames"]):
+        if tick_a != tick_b or hash_a != hash_b:
+            frame_tick = min(tick_a, tick_b)
+            break
+    else:
+        common = min(len(a["frames"]), len(b["frames"]))
+        extra = a["frames"][common:] or b["frames"][common:]
+        if extra:
+            frame_tick = extra[0][0]
+    pressure_tick = None
+    for tick, (p_a, p_b) in enumerate(zip(a["pressure"], b["pressure"])):
+        if abs(p_a - p_b) > tolerance * max(1.0, abs(p_a), abs(p_b)):
+            pressure_tick = tick
+            break
+    ticks = [t for t in (frame_tick, pressure_tick) if t is not None]
+    return min(ticks) if ticks else None
+
+
+def main():
+    args = parse_args()
+    if not args.skip_build:
+        build(args, ROOT, args.build_dir)
+    se2 = os.path.join(args.build_dir, "SE2_CPP_HW2")
+    raw = os.path.join(args.build_dir, "raw_fluid")
+
+    workdir = None
+    try:
+        if args.speed_ref:
+            workdir = tempfile.mkdtemp(prefix="se2_regression_")
+            se2_ref = build_reference(args, workdir)
+        else:
+            se2_ref = None
+        return check(args, se2, raw, se2_ref)
+    finally:
+        if workdir is not None:
+            subprocess.run(["git", "-C", ROOT, "worktree", "remove", "--force", os.path.join(workdir, "tree")],
+                           stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+            shutil.rmtree(workdir, ignore_errors=True)
+
+
+def check(args, se2, raw, se2_ref):
+    baseline = None
+    if os.path.exists(args.baseline) and not args.update:
+        with open(args.baseline) as file:
+            baseline = json.load(file)
+        if baseline["ticks"] != args.ticks or baseline["seed"] != args.seed:
+            print("Error: baseline was recorded for %d ticks and seed %d, rerun with --update"
+                  % (baseline["ticks"], baseline["seed"]))
+            return 1
+
+    failures = []
+    results = {"ticks": args.ticks, "seed": args.seed, "maps": {}}
+    for path in args.maps:
+        full_path = os.path.join(ROOT, path)
+        rows, _ = map_size(full_path)
+        common = ["--field=" + full_path, "--ticks=%d" % args.ticks, "--seed=%d" % args.seed, "--log-p=1"]
+        map_results = results["maps"][path] = {}
+        map_baseline = (baseline or {}).get("maps", {}).get(path, {})
+
+        reference = None
+        if map_size(full_path) == RAW_SIZE:
+            reference, elapsed = run([raw] + common, rows)
+            map_results["raw_fluid"] = reference
+            print("%-12s %-42s %8.1f ticks/s" % (path, "raw_fluid", args.ticks / elapsed))
+
+        for config in args.configs:
+            p_type, v_type, vf_type = config.split("/")
+            golden = map_baseline.get(config)
+            entry = None
+            for threads in args.threads:
+                options = ["--p-type=" + p_type, "--v-type=" + v_type, "--v-flow-type=" + vf_type,
+                           "--threads-count=%d" % threads] + common
+                result, elapsed = run([se2] + options, rows)
+                speed = args.ticks / elapsed
+                name = "%s x%d" % (config, threads)
+                if se2_ref is None:
+                    print("%-12s %-42s %8.1f ticks/s" % (path, name, speed))
+                else:
+                    # Версии чередуются, чтобы фоновая нагрузка машины сказалась на обеих одинаково
+                    ref_elapsed = float("inf")
+                    for repeat in range(args.repeats):
+                        ref_elapsed = min(ref_elapsed, run([se2_ref] + options, rows)[1])
+                        if repeat > 0:
+                            elapsed = min(elapsed, run([se2] + options, rows)[1])
+                    speed = args.ticks / elapsed
+                    ref_speed = args.ticks / ref_elapsed
+                    print("%-12s %-42s %8.1f ticks/s, %s %.1f ticks/s" % (path, name, speed, args.speed_ref, ref_speed))
+                    if speed < ref_speed * (1 - args.max_slowdown):
+                        failures.append("%s: %s is slower than %s: %.1f < %.1f ticks/s"
+                                        % (path, name, args.speed_ref, speed, ref_speed))
+                if entry is None:
+                    entry = result
+                elif (tick := first_divergence(entry, result, args.p_tolerance)) is not None:
+                    failures.append("%s: %s differs from %d threads at tick %d"
+                                    % (path, name, args.threads[0], tick))
+
+                if golden is not None and (tick := first_divergence(golden, result, args.p_tolerance)) is not None:
+                    failures.append("%s: %s differs from baseline at tick %d" % (path, name, tick))
+
+            if reference is not None and config == "/".join([RAW_TYPE] * 3):
+                entry["reference_divergence"] = first_divergence(reference, entry, args.p_tolerance)
+                print("%-12s %-42s diverges from raw_fluid at tick %s"
+                      % (path, config, entry["reference_divergence"]))
+                if golden is not None and "reference_divergence" in golden:
+                    old, new = golden["reference_divergence"], entry["reference_divergence"]
+                    if new is not None and (old is None or new < old):
+                        failures.append("%s: %s diverges from raw_fluid at tick %d, baseline %s"
+                                        % (path, config, new, old))
+            map_results[config] = entry
+
+        if reference is not None and "raw_fluid" in map_baseline:
+            if (tick := first_divergence(map_baseline["raw_fluid"], reference, args.p_tolerance)) is not None:
+                failures.append("%s: raw_fluid differs from baseline at tick %d" % (path, tick))
+
+    if args.update:
+        with open(args.baseline, "w") as file:
+            json.dump(results, file, indent=1)
+            file.write("\n")
+        print("Baseline written to " + args.baseline)
+        return 0
+
+    if baseline is None:
+        print("No baseline at %s, run with --update to record one" % args.baseline)
+    for failure in failures:
+        print("FAIL: " + failure)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+"""Сильное и слабое масштабирование SE2_CPP_HW2 по потокам на картах из tools/gen_map.py.
+
+Для каждой комбинации типов и каждого размера квадратной карты из `--sizes` программа запускается с числом потоков из
+`--threads`, с `--perf-counters=0 --output=none`. Из сводки счётчиков берётся время каждой фазы тика, а из неё
+считаются тики в секунду и эффективность фазы:
+
+* сильное масштабирование - карта одна, эффективность `T(1) / (p * T(p))`;
+* слабое - на `p` потоках карта со стороной `base * sqrt(p)` (площадь на поток постоянна), эффективность
+  `T(1, base) / T(p, base * sqrt(p))`.
+
+Фазы `apply_forces_on_flow` и `apply_move_on_flow` последовательные, их эффективность показывает долю тика, которую
+потоки не ускоряют. Число тиков для карты - `--cell-ticks / площадь`, но не меньше `--min-ticks`. Результаты
+можно сохранить в JSON (`--json`).
+"""
+
+import argparse
+import itertools
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_map  # noqa: E402
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PHASES = ["apply_external_forces", "apply_p_forces", "apply_forces_on_flow", "recalculate_p", "apply_move_on_flow"]
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--build-dir", default=os.path.join(ROOT, "_scaling_build"))
+    parser.add_argument("--types", default="FIXED(64,8),DOUBLE", help="типы сборки, как FLUID_TYPES")
+    parser.add_argument("--all-combinations", action="store_true",
+                        help="все тройки p/v/v-flow из --types, по умолчанию только одинаковые")
+    parser.add_argument("--sizes", nargs="+", type=int, default=[64, 128, 256, 512, 1024, 2048, 4096],
+                        help="стороны карт для сильного масштабирования")
+    parser.add_argument("--weak-base", nargs="*", type=int, default=[64, 256],
+                        help="стороны карт на одном потоке для слабого масштабирования")
+    parser.add_argument("--threads", nargs="+", type=int,
+                        default=[1 << i for i in range((os.cpu_count() or 1).bit_length())])
+    parser.add_argument("--cell-ticks", type=int, default=64 * 64 * 200, help="клеткотиков на один запуск")
+    parser.add_argument("--min-ticks", type=int, default=3)
+    parser.add_argument("--seed", type=int, default=1, help="seed генератора карт")
+    parser.add_argument("--json", help="сохранить результаты в файл")
+    parser.add_argument("--skip-build", action="store_true")
+    return parser.parse_args()
+
+
+def split_types(types):
+    """Разбивает список типов по запятым вне скобок: `FIXED(64,8),DOUBLE`"""
+    return [name.strip() for name in re.findall(r"[^,(]+(?:\([^)]*\))?", types) if name.strip()]
+
+
+def build(args):
+    subprocess.run(["cmake", "-S", ROOT, "-B", args.build_dir, "-DFLUID_TYPES=" + args.types],
+                   check=True, stdout=subprocess.DEVNULL)
+    subprocess.run(["cmake", "--build", args.build_dir, "-j", str(os.cpu_count() or 1), "--target", "SE2_CPP_HW2"],
+                   check=True, stdout=subprocess.DEVNULL)
+
+
+def make_map(args, side):
+    path = os.path.join(args.build_dir, "maps", "scaling_%d_%d.txt" % (side, args.seed))
+    if not os.path.exists(path):
+        os.makedirs(os.path.dirname(path), exist_ok=True)
+        scale = max(1, side // 64)
+        lines = gen_map.generate(side, side, pools=2 * scale, channels=2, obstacles=8 * scale, seed=args.seed)
+        with open(path, "w") as file:
+            gen_map.write(lines, file)
+    return path
+
+
+def run(se2, config, path, side, threads, args):
+    """Время фаз в секундах на тик и тики в секунду"""
+    ticks = max(args.min_ticks, args.cell_ticks // (side * side))
+    p_type, v_type, vf_type = config
+    command = [se2, "--p-type=" + p_type, "--v-type=" + v_type, "--v-flow-type=" + vf_type, "--field=" + path,
+               "--threads-count=%d" % threads, "--ticks=%d" % ticks, "--output=none", "--perf-counters=0"]
+    start = time.perf_counter()
+    result = subprocess.run(command, capture_output=True, text=True)
+    if result.returncode != 0:
+        raise RuntimeError("`%s` exited with %d\n%s" % (" ".join(command), result.returncode, result.stdout[-500:]))
+    phases = {}
+    for line in result.stdout.splitlines():
+        fields = line.split()
+        if len(fields) >= 3 and (fields[0] in PHASES or fields[0] == "tick"):
+            phases[fields[0]] = phases.get(fields[0], 0) + float(fields[2]) / 1000 / ticks
+    if "tick" not in phases:
+        raise RuntimeError("no perf counters summary in the output of `%s`" % " ".join(command))
+    return {"ticks": ticks, "ticks_per_sec": 1 / phases["tick"], "phases": phases,
+            "wall_sec": time.perf_counter() - start}
+
+
+def efficiency(base, result, threads):
+    """Эффективность по фазам относительно `base`: `T(base) / (threads * T)`"""
+    return {name: base["phases"][name] / (threads * result["phases"][name])
+            for name in ["tick"] + PHASES if result["phases"].get(name) and base["phases"].get(name)}
+
+
+def print_row(label, threads, result, eff):
+    print("%-34s %3d threads %9.2f ticks/s  eff %s" % (
+        label, threads, result["ticks_per_sec"],
+        " ".join("%s=%.2f" % (name, eff[name]) for name in ["tick"] + PHASES if name in eff)))
+
+
+def main():
+    args = parse_args()
+    if not args.skip_build:
+        build(args)
+    se2 = os.path.join(args.build_dir, "SE2_CPP_HW2")
+
+    types = split_types(args.types)
+    if args.all_combinations:
+        configs = list(itertools.product(types, repeat=3))
+    else:
+        configs = [(name, name, name) for name in types]
+
+    results = {"threads": args.threads, "strong": {}, "weak": {}}
+    for config in configs:
+        name = "/".join(config)
+        strong = results["strong"][name] = {}
+        for side in args.sizes:
+            path = make_map(args, side)
+            runs = strong[str(side)] = {}
+            for threads in args.threads:
+                result = run(se2, config, path, side, threads, args)
+                base = runs.get(str(args.threads[0]), result)
+                result["efficiency"] = efficiency(base, result, threads / args.threads[0])
+                runs[str(threads)] = result
+                print_row("strong %s %dx%d" % (name, side, side), threads, result, result["efficiency"])
+
+        weak = results["weak"][name] = {}
+        for base_side in args.weak_base:
+            runs = weak[str(base_side)] = {}
+            base = None
+            for threads in args.threads:
+                side = int(round(base_side * math.sqrt(threads / args.threads[0])))
+                result = run(se2, config, make_map(args, side), side, threads, args)
+                result["side"] = side
+                # Сравнивается время на площадь одного потока: на большой карте другое число тиков и клеток
+                area = side * side / threads
+                normalized = {"phases": {phase: t / area for phase, t in result["phases"].items()}}
+                base = base or normalized
+                result["efficiency"] = efficiency(base, normalized, 1)
+                runs[str(threads)] = result
+                print_row("weak %s %dx%d" % (name, side, side), threads, result, result["efficiency"])
+
+    if args.json:
+        with open(args.json, "w") as file:
+            json.dump(results, file, indent=1)
+            file.write("\n")
+        print("Results written to " + args.json)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())